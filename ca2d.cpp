@@ -5,7 +5,55 @@
 // (c)2015 P1X
 // http://p1x.in
 //
-// gcc -Os ca2d.cpp -o ca2d.app -lglut -lGL -lGLU -lm
+// gcc -Os -fopenmp ca2d.cpp ca_engine.cpp -o ca2d.app -lglut -lGL -lGLU -lm -lpthread -lrt
+//
+// PNG export:
+// gcc -Os -fopenmp -DCA_PNG ca2d.cpp ca_engine.cpp -o ca2d.app -lglut -lGL -lGLU -lm -lpthread -lrt -lpng
+//
+// Larger than Life, radius 5 box, birth 34-45, survival 33-57:
+// ./ca2d.app --ltl R5,B34-45,S33-57
+//
+// Continuous (Lenia) mode with a radius 20 kernel of two rings:
+// ./ca2d.app --lenia 20 --lenia-peaks 1,0.5
+//
+// Headless export (no window):
+// ./ca2d.app --export frames/ca_%06i.ppm --frames 600 --size 640x320
+// ./ca2d.app --export - --wait | ffmpeg -f rawvideo -pix_fmt rgb24 -s 640x320 -i - ca.mp4
+//
+// Per-generation stats to CSV (or raw records with a .bin name):
+// ./ca2d.app --telemetry stats.csv
+//
+// Live grid in shared memory for other processes (see ca_watch.cpp):
+// ./ca2d.app --publish /ca2d
+//
+// Grid memory: huge pages (normal, thp or huge) and where they landed:
+// ./ca2d.app --pages thp --memory
+//
+// Checkpoint every 1000 generations, keep the last 3, and resume later:
+// ./ca2d.app --checkpoint ckpt --checkpoint-every 1000 --checkpoint-keep 3
+// ./ca2d.app --checkpoint ckpt --restore ckpt
+//
+// Life kernels for a given instruction set (scalar, sse, avx2, avx512),
+// the default is the best the CPU has up to avx2:
+// ./ca2d.app --isa avx512
+//
+// Cycles, IPC, cache and branch misses of the step, swap and draw phases
+// (per thread for the step), every 100 generations in the HUD, or on
+// stderr when exporting:
+// ./ca2d.app --counters 100
+//
+// Keep up to 256 MB of history to step back through (z/x or left/right,
+// Z/X by ten, v carries on from there; 0 turns it off):
+// ./ca2d.app --rewind 256
+//
+// The same rule on a plane without edges (w/a/s/d move the view over it;
+// no rewind or checkpoints there):
+// ./ca2d.app --world
+//
+// Start from a pattern (Life RLE or Macrocell) centred on the board, or
+// with its bottom left corner at x,y; Life files switch to Conway:
+// ./ca2d.app --load gosper.rle
+// ./ca2d.app --world --load metapixel.mc --at -500,200
 //
 // ----------------------------------------
 
@@ -15,8 +63,22 @@
 #include <GL/freeglut.h>
 #include <GL/gl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#ifdef CA_PNG
+#include <png.h>
+#endif
+#include "ca_telemetry.h"
+#include "ca_scheduler.h"
+#include "ca_engine.h"
+#include "ca_publish.h"
+#include "ca_checkpoint.h"
+#include "ca_counters.h"
+#include "ca_rewind.h"
+#include "ca_import.h"
 
 // SYSTEM VARS
 // ----------------------------------------
@@ -31,24 +93,48 @@ int windowPosX       = 50;
 int windowPosY       = 50;
 int refreshMills     = 1000/FPS;
 float camera_scale   = 24.0f;
+int view_width       = 640;
+int view_height      = 320;
 
 // AUTOMATION VARS
 // ----------------------------------------
+// the simulation lives in ca_engine; cells_main_array is a read-only view
+// of its current generation, refreshed after every step
 static int CELLS_ARRAY_SIZE[]    = {84, 48};
 static int MAX_CELLS             = CELLS_ARRAY_SIZE[0]*CELLS_ARRAY_SIZE[1];
-float cells_main_array[84][48];
-float cells_buffer_array[84][48];
-
-static float CELL_START_COLOR = 0.5f;
-static float CELL_STEP_COLOUR = 0.005f;
-static float CELL_MIN_COLOUR  = 0.05f;
-static float CELL_MAX_COLOUR  = 1.0f;
-bool automation_mode          = false;
+ca_engine *engine                = NULL;
+ca_rule rule;
+const float (*cells_main_array)[48];
+// with --world the board is a window at world_view onto a ca_world
+bool world_mode                  = false;
+ca_world *world                  = NULL;
+int world_view[]                 = {-42, -24};
+float world_cells[84 * 48];
+float world_read_cells[84 * 48];
+
 bool show_info                = false;
+const char *restore_dir       = NULL;
+// --load: a pattern centred on the board, or at load_at with --at
+const char *load_path         = NULL;
+int load_at[3]                = {0, 0, 0};
+bool load_centre              = true;
+bool show_memory              = false;
+int isa                       = -1;
 int stat_iteration            = 0;
 int stat_alive                = 0;
 int stat_change               = 0;
 
+// LOD VARS
+// ----------------------------------------
+// level n keeps one entry per 2^n x 2^n block: how many cells are alive
+// and the sum of their colours, level 0 is the grid itself
+static int LOD_MAX_LEVELS     = 8;
+int lod_levels                = 1;
+int lod_size[8][2];
+int *lod_count[8];
+double *lod_sum[8];
+int stat_lod_level            = 0;
+
 // INIT
 // ----------------------------------------
 
@@ -59,25 +145,11 @@ void initGL() {
 // HELPERS
 // ----------------------------------------
 
-float random_f(){
-   float r = (float)rand() / (float)RAND_MAX;
-   return r;
-}
-
-float random_fcolor(){
-   float r = random_f();
-   if (r < 0.2f){
-      r = 0.0f;
-   }
-   if  (r > 0.8f){
-      r = 0.8f;
-   }
-   return r;
-}
-
 void reshape(GLsizei width, GLsizei height) {
    if (height == 0) height = 1;
    GLfloat aspect = (GLfloat)width / (GLfloat)height;
+   view_width = width;
+   view_height = height;
 
    glViewport(0, 0, width, height);
 
@@ -102,156 +174,285 @@ void change_fps(int change_fps){
    refreshMills = 1000/FPS;
 }
 
-// CELLULAR AUTOMATION
+void change_zoom(float zoom){
+   camera_scale *= zoom;
+   if (camera_scale < 4.0f){
+      camera_scale = 4.0f;
+   }
+   if (camera_scale > 4096.0f){
+      camera_scale = 4096.0f;
+   }
+   reshape(view_width, view_height);
+}
+
+// LEVEL OF DETAIL
 // ----------------------------------------
 
-void init_arrays(){
+void lod_setup(){
+   int w = CELLS_ARRAY_SIZE[0];
+   int h = CELLS_ARRAY_SIZE[1];
+
+   lod_size[0][0] = w;
+   lod_size[0][1] = h;
+   lod_levels = 1;
+   while ((w > 1 or h > 1) and lod_levels < LOD_MAX_LEVELS){
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+      lod_size[lod_levels][0] = w;
+      lod_size[lod_levels][1] = h;
+      lod_count[lod_levels] = (int*)calloc(w * h, sizeof(int));
+      lod_sum[lod_levels] = (double*)calloc(w * h, sizeof(double));
+      lod_levels++;
+   }
+}
+
+// moves one cell from old to new colour in every level above the grid
+void lod_update(int x, int y, float old_cell, float new_cell){
+   int alive = (new_cell > 0.0f) - (old_cell > 0.0f);
+   float colour = new_cell - old_cell;
+
+   for (int l = 1; l < lod_levels; l++){
+      int i = (y >> l) * lod_size[l][0] + (x >> l);
+      lod_count[l][i] += alive;
+      lod_sum[l][i] += colour;
+      if (lod_count[l][i] == 0){
+         lod_sum[l][i] = 0.0f;
+      }
+   }
+}
 
+void lod_reset(){
+   for (int l = 1; l < lod_levels; l++){
+      memset(lod_count[l], 0, lod_size[l][0] * lod_size[l][1] * sizeof(int));
+      memset(lod_sum[l], 0, lod_size[l][0] * lod_size[l][1] * sizeof(double));
+   }
    for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
       for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-         cells_main_array[x][y] = 0.0f;
-         cells_buffer_array[x][y] = 0.0f;
+         lod_update(x, y, 0.0f, cells_main_array[x][y]);
       }
    }
 }
 
-void fill_array(){
-   float new_cell;
+// first level where one block covers at least a pixel
+int lod_pick_level(){
+   int pixels = view_width < view_height ? view_width : view_height;
+   float cell_pixels = pixels / (2.0f * camera_scale);
+   int level = 0;
 
-   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++ ){
-         if (random_f() >= 0.85){
-            cells_main_array[x][y] = CELL_START_COLOR;
-         }else{
-            cells_main_array[x][y] = 0.0f;
-         }
-      }
+   while (level < lod_levels - 1 and cell_pixels * (1 << level) < 1.0f){
+      level++;
    }
+   return level;
+}
+
+// CELLULAR AUTOMATION
+// ----------------------------------------
 
-   stat_iteration = 0;
+// cells the rewind view changes
+void view_changed(void *user, int x, int y, int z, float old_cell, float new_cell){
+   lod_update(x, y, old_cell, new_cell);
 }
 
-int count_cells(int cx, int cy, float treshold){
-   int count = 0;
+void engine_changed(void *user, int x, int y, int z, float old_cell, float new_cell){
+   rewind_record(x, y, z, old_cell);
+   view_changed(user, x, y, z, old_cell, new_cell);
+}
 
-   for (int y = cy-1; y <= cy+1; y++){
-      for (int x = cx-1; x <= cx+1; x++){
-         if (x >= 0 and y >= 0 and x < CELLS_ARRAY_SIZE[0] and y < CELLS_ARRAY_SIZE[1] and !( x == cx and y == cy)){
-            if (cells_main_array[x][y] > treshold){
-               count++;
-            }
+// the engine's grid, the generation on view while rewound, or the
+// window onto the world; the levels above the window follow the cells
+// that differ from the last read, a pan included
+void update_view(){
+   if (world){
+      const ca_stats *stats = ca_world_get_stats(world);
+      ca_world_read(world, world_view[0], world_view[1], CELLS_ARRAY_SIZE[0], CELLS_ARRAY_SIZE[1], world_read_cells);
+      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+         for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+            int i = x * CELLS_ARRAY_SIZE[1] + y;
+            if (world_read_cells[i] == world_cells[i]) continue;
+            lod_update(x, y, world_cells[i], world_read_cells[i]);
+            world_cells[i] = world_read_cells[i];
          }
       }
+      cells_main_array = (const float (*)[48])world_cells;
+      stat_iteration = stats->iteration;
+      stat_alive = stats->alive;
+      stat_change = stats->change;
+      return;
    }
-
-   return count;
+   cells_main_array = (const float (*)[48])rewind_cells(engine);
+   rewind_stats(engine, &stat_iteration, &stat_alive, &stat_change);
 }
 
-float cell_gain_colour(float colour){
-   float new_colour = colour + CELL_STEP_COLOUR;
-   if (new_colour > CELL_MAX_COLOUR){
-      new_colour = CELL_MAX_COLOUR;
+void publish_view(){
+   if (world){
+      publish_frame(world_cells, ca_world_get_stats(world));
+   }else{
+      publish_frame(ca_cells(engine), ca_get_stats(engine));
    }
-   return new_colour;
 }
 
-float cell_lose_colour(float colour){
-   float new_colour = colour - CELL_STEP_COLOUR;
-   if (new_colour < CELL_MIN_COLOUR){
-      new_colour = CELL_MIN_COLOUR;
+void fill_array(){
+   if (world){
+      ca_world_clear(world);
+      if (!ca_world_fill_random(world, world_view[0], world_view[1], CELLS_ARRAY_SIZE[0], CELLS_ARRAY_SIZE[1])){
+         fprintf(stderr, "out of memory\n");
+         exit(1);
+      }
+   }else{
+      rewind_edit_begin(engine, view_changed, NULL);
+      ca_fill_random(engine);
+      rewind_edit_end(engine);
    }
-   return new_colour;
+   update_view();
+   lod_reset();
+   publish_view();
 }
 
-void automation(){
-   int count;
-   float cell;
-   float new_cell;
+// moves the window over the world
+void world_pan(int x, int y){
+   if (!world) return;
+   world_view[0] += x;
+   world_view[1] += y;
+   update_view();
+}
 
-   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-         count = count_cells(x, y, 0.0f);
-         cell = cells_main_array[x][y];
-         if (cell > 0.0f){
-            if (count < 2 or count > 3){
-               new_cell = 0.0f;
-            }else{
-               new_cell = cell_gain_colour(cell);
-            }
-         }else{
-            if (count == 3){
-               new_cell = CELL_START_COLOR;
-            }else{
-               new_cell = 0.0f;
-            }
-         }
-         cells_buffer_array[x][y] = new_cell;
-      }
+// continues the run saved in the newest checkpoint
+void restore_array(){
+   rewind_edit_begin(engine, view_changed, NULL);
+   if (!checkpoint_restore(engine, restore_dir, "ca2d")){
+      exit(1);
    }
+   rewind_edit_end(engine);
+   rule = *ca_get_rule(engine);
+   update_view();
+   lod_reset();
+   publish_frame(ca_cells(engine), ca_get_stats(engine));
 }
 
-void automation2(){
-   int count;
-   float cell;
-   float new_cell;
+void change_rule(){
+   if (!ca_set_rule(engine, &rule)){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   rule = *ca_get_rule(engine);
+   if (world) ca_world_set_rule(world, &rule);
+}
 
-   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-         count = count_cells(x, y, 0.3f);
-         cell = cells_main_array[x][y];
-         if (cell > 0.2f){
-            if (count < 2 or count > 3){
-               new_cell = cell_lose_colour(cell);
-            }else{
-               new_cell = cell_gain_colour(cell);
-            }
-         }else{
-            if (count == 3){
-               new_cell = cell_gain_colour(cell);
-            }else{
-               new_cell = 0.0f;
-            }
-         }
-         cells_buffer_array[x][y] = new_cell;
+// the --load pattern in place of a random fill
+void load_array(){
+   import_target target;
+   int at[3] = {load_at[0], load_at[1], 0};
+   // live cells get the colour of a newborn one
+   const float alive = 0.5f;
+   bool ok;
+   if (world){
+      if (load_centre){
+         at[0] = world_view[0] + CELLS_ARRAY_SIZE[0] / 2;
+         at[1] = world_view[1] + CELLS_ARRAY_SIZE[1] / 2;
+      }
+      ok = import_into_world(world, load_path, at, load_centre, alive, &target);
+   }else{
+      if (load_centre){
+         at[0] = CELLS_ARRAY_SIZE[0] / 2;
+         at[1] = CELLS_ARRAY_SIZE[1] / 2;
       }
+      rewind_edit_begin(engine, view_changed, NULL);
+      ok = import_into_engine(engine, load_path, at, load_centre, alive, &target);
+      rewind_edit_end(engine);
+   }
+   if (!ok){
+      exit(1);
+   }
+   if (import_is_life(&target)){
+      rule.kind = CA_RULE_LIFE;
+      rule.conway = true;
+      change_rule();
+   }else{
+      fprintf(stderr, "%s: rule %s is not Life, keeping the current rule\n", load_path, target.rule);
    }
+   fprintf(stderr, "%s: %ix%i, %li cells placed\n", load_path, target.size[0], target.size[1], target.cells);
+   update_view();
+   lod_reset();
+   publish_view();
 }
 
-void swap_arrays(){
-   float old_cell;
-   float new_cell;
-   stat_alive = 0;
-   stat_change = 0;
-
-   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-         old_cell = cells_main_array[x][y];
-         new_cell = cells_buffer_array[x][y];
-         cells_main_array[x][y] = new_cell;
-         if (new_cell > 0.0f) stat_alive++;
-         if (old_cell != new_cell) stat_change++;
+ void init_automation(){
+   lod_setup();
+   engine = ca_create(2, CELLS_ARRAY_SIZE, &rule);
+   if (!engine){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+   }
+   ca_set_isa(engine, isa);
+   if (world_mode){
+      world = ca_world_create(&rule);
+      if (!world){
+         fprintf(stderr, "out of memory\n");
+         exit(1);
       }
+      ca_world_set_isa(world, isa);
+   }
+   ca_set_change_hook(engine, engine_changed, NULL);
+   if (counters_on) ca_set_phase_hook(engine, counters_engine_phase, NULL);
+   ca_set_detailed_stats(engine, telemetry_file != NULL);
+   if (show_memory){
+      char report[256];
+      ca_memory_report(engine, report, sizeof(report));
+      fprintf(stderr, "%s\n", report);
    }
+   if (restore_dir and !world){
+      restore_array();
+   }else if (load_path){
+      load_array();
+   }else{
+      fill_array();
+   }
+   if (!world) rewind_start(engine);
 }
-void clear_buffer_array(){}
 
- void init_automation(){
-   init_arrays();
-   fill_array();
+// steps the view through the history (negative is back)
+void rewind_view_step(int generations){
+   rewind_step(engine, generations, view_changed, NULL);
+   update_view();
 }
 
-void run_automation(){
-   if (automation_mode){
-      automation();
-   }else{
-      automation2();
+// carries on from the generation on view
+void rewind_continue(){
+   rewind_resume(engine);
+   update_view();
+   publish_frame(ca_cells(engine), ca_get_stats(engine));
+}
+
+void run_world(){
+   if (!ca_world_step(world, 1)){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
    }
-   if (stat_alive > 0) {
-      stat_iteration++;
+   update_view();
+   telemetry_push(ca_world_get_stats(world));
+   publish_view();
+   counters_tick();
+}
+
+// false when no generation ran
+bool run_automation(){
+   if (world){
+      run_world();
+      return true;
    }
-   swap_arrays();
+   // paused while looking back
+   if (rewind_viewing) return false;
+   ca_step(engine, 1);
+   rewind_tick(engine);
+   update_view();
+   telemetry_push(ca_get_stats(engine));
+   publish_frame(ca_cells(engine), ca_get_stats(engine));
+   checkpoint_tick(engine);
+   counters_tick();
+   return true;
 }
 
+
 // INPUT
 // ----------------------------------------
 
@@ -264,11 +465,72 @@ void keyboard(unsigned char key, int x, int y) {
          fill_array();
          break;
       case 32: // space
-         automation_mode = !automation_mode;
+         rule.conway = !rule.conway;
+         change_rule();
          break;
       case 73: // i
          show_info = !show_info;
          break;
+      case 103: // g
+         sched_next_mode();
+         break;
+      case 108: // l
+         rule.kind = rule.kind == CA_RULE_LENIA ? CA_RULE_LIFE : CA_RULE_LENIA;
+         change_rule();
+         fill_array();
+         break;
+      case 116: // t
+         rule.kind = rule.kind == CA_RULE_LTL ? CA_RULE_LIFE : CA_RULE_LTL;
+         change_rule();
+         fill_array();
+         break;
+      case 44: // ,
+         rule.lenia_radius--;
+         change_rule();
+         break;
+      case 46: // .
+         rule.lenia_radius++;
+         change_rule();
+         break;
+      case 91: // [
+         sched_change_target(0.5f);
+         break;
+      case 93: // ]
+         sched_change_target(2.0f);
+         break;
+      case 43: // +
+         change_zoom(0.5f);
+         break;
+      case 45: // -
+         change_zoom(2.0f);
+         break;
+      case 122: // z
+         rewind_view_step(-1);
+         break;
+      case 120: // x
+         rewind_view_step(1);
+         break;
+      case 90: // Z
+         rewind_view_step(-10);
+         break;
+      case 88: // X
+         rewind_view_step(10);
+         break;
+      case 118: // v
+         rewind_continue();
+         break;
+      case 119: // w
+         world_pan(0, 8);
+         break;
+      case 115: // s
+         world_pan(0, -8);
+         break;
+      case 97: // a
+         world_pan(-8, 0);
+         break;
+      case 100: // d
+         world_pan(8, 0);
+         break;
    }
 }
 
@@ -284,14 +546,16 @@ void specialKeys(int key, int x, int y) {
          }
          break;
       case GLUT_KEY_RIGHT:
+         rewind_view_step(1);
          break;
       case GLUT_KEY_LEFT:
+         rewind_view_step(-1);
          break;
       case GLUT_KEY_UP:
-         //change_fps(1);
+         change_fps(1);
          break;
       case GLUT_KEY_DOWN:
-         //change_fps(-1);
+         change_fps(-1);
          break;
    }
 }
@@ -310,9 +574,10 @@ void mouse(int button, int state, int x, int y) {
 // ----------------------------------------
 
 void Timer(int value) {
-   run_automation();
-   glutPostRedisplay();
-   glutTimerFunc(refreshMills, Timer, 0);
+   if (sched_run(run_automation, refreshMills)){
+      glutPostRedisplay();
+   }
+   glutTimerFunc(sched_delay(refreshMills), Timer, 0);
 }
 
 void draw_floor(){
@@ -332,15 +597,30 @@ void draw_floor(){
 }
 
 void draw_stats(){
-   char buf[256];
+   char buf[520];
 
    glPushMatrix();
    glTranslatef (-camera_scale, camera_scale-2, 0);
       // TITLE
    glColor3f(0.0f, 0.0f, 0.2f);
    glRasterPos3f(0.0f, 0.0f, 0.0f);
-   snprintf(buf, sizeof(buf) - 1, "%s - version %f", title, VERSION);
+   snprintf(buf, sizeof(buf) - 1, "%s - version %f\nSCHEDULER: [%s %.0f] GEN/S: [%.1f] FRAME: [%.1fms]",
+      title, VERSION, SCHED_NAMES[sched_mode], sched_target, stat_gens_per_sec, stat_frame_ms);
    glutBitmapString( GLUT_BITMAP_9_BY_15, (unsigned char*) buf);
+   if (counters_on){
+      snprintf(buf, sizeof(buf) - 1, "\n%s\n%s", stat_counters[0], stat_counters[1]);
+      glutBitmapString( GLUT_BITMAP_9_BY_15, (unsigned char*) buf);
+   }
+   if (rewind_on){
+      buf[0] = '\n';
+      rewind_status(buf + 1, sizeof(buf) - 1);
+      glutBitmapString( GLUT_BITMAP_9_BY_15, (unsigned char*) buf);
+   }
+   if (world){
+      int used = snprintf(buf, sizeof(buf) - 1, "\nWORLD: [%i %i] ", world_view[0], world_view[1]);
+      ca_world_report(world, buf + used, sizeof(buf) - 1 - used);
+      glutBitmapString( GLUT_BITMAP_9_BY_15, (unsigned char*) buf);
+   }
    glPopMatrix();
 
    glPushMatrix();
@@ -348,7 +628,7 @@ void draw_stats(){
    // STATS
    glColor3f(0.0f, 0.0f, 0.2f);
    glRasterPos3f(0.0f, 0.0f, 0.0f);
-   snprintf(buf, sizeof(buf) - 1, "ITERATION: [%i] ALIVE: [%i/%i] CHANGE: [%i]", stat_iteration, stat_alive, MAX_CELLS, stat_change);
+   snprintf(buf, sizeof(buf) - 1, "ITERATION: [%i] ALIVE: [%i/%i] CHANGE: [%i] LOD: [%i] ISA: [%s]", stat_iteration, stat_alive, MAX_CELLS, stat_change, stat_lod_level, ca_isa_name(world ? ca_world_get_isa(world) : ca_get_isa(engine)));
    glutBitmapString( GLUT_BITMAP_9_BY_15, (unsigned char*) buf);
    glPopMatrix();
 }
@@ -377,10 +657,55 @@ void draw_one_cell(float x, float y, float size){
    glPopMatrix();
 }
 
+// one block of a LOD level, drawn like draw_one_cell() with the mean
+// colour and an area that matches the number of alive cells in it
+void draw_one_block(float x, float y, int level, int count, float sum){
+   float cell = sum / count;
+   float span = (float)(1 << level);
+   float size = cell * span * sqrtf(count / (span * span));
+
+   glPushMatrix();
+   glTranslatef (x, y, 0.0f);
+   glColorMaterial ( GL_FRONT, GL_AMBIENT_AND_DIFFUSE ) ;
+   glEnable ( GL_COLOR_MATERIAL ) ;
+   float color[] = {cell > 0.45f ? 0.45f : cell, cell > 0.45f ? 0.45f : cell};
+   color[0] += y*0.01f;
+   color[1] += x*0.01f;
+   glColor4f(0.4f, color[0], color[1], 1.0f);
+   glRotatef(cell*45.0f, 1.0f, 1.0f, 1.0f);
+   glutSolidCube(size);
+   glPopMatrix();
+}
+
+void draw_lod_cells(int level){
+   float half_size[] = {CELLS_ARRAY_SIZE[0] * 0.5f, CELLS_ARRAY_SIZE[1] * 0.5f};
+   float span = (float)(1 << level);
+
+   for (int y = 0; y < lod_size[level][1]; y++){
+      for (int x = 0; x < lod_size[level][0]; x++){
+         int i = y * lod_size[level][0] + x;
+         if (lod_count[level][i] > 0){
+            draw_one_block((x + 0.5f) * span - 0.5f - half_size[0],
+                           (y + 0.5f) * span - 0.5f - half_size[1],
+                           level, lod_count[level][i], lod_sum[level][i]);
+         }
+      }
+   }
+}
+
 void draw_cells(){
    float cell;
    float half_size[] = {CELLS_ARRAY_SIZE[0] * 0.5f, CELLS_ARRAY_SIZE[1] * 0.5f};
 
+   stat_lod_level = lod_pick_level();
+   if (stat_lod_level > 0){
+      draw_lod_cells(stat_lod_level);
+      if (show_info){
+         draw_stats();
+      }
+      return;
+   }
+
 
    for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
       for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
@@ -411,6 +736,8 @@ void camera_movement(){
 }
 
 void display() {
+   sched_draw_begin();
+   counters_switch(COUNTER_DRAW);
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
    //glEnable(GL_DEPTH_TEST);
    
@@ -421,6 +748,9 @@ void display() {
    //draw_floor();
    draw_cells();
    //camera_movement();
+   glFinish();
+   counters_switch(COUNTER_IDLE);
+   sched_draw_end();
    glutSwapBuffers();
 }
 
@@ -466,11 +796,334 @@ void add_point_light(const float x, const float y, const float z, const float am
  
 }
 
+// HEADLESS EXPORT
+// ----------------------------------------
+// renders the 2D view in software and hands frames to a small pool of
+// encoder threads; when every slot is busy the frame is dropped so the
+// simulation never waits for the disk (--wait keeps every frame instead)
+
+static int EXPORT_SLOTS   = 8;
+static int EXPORT_FREE    = 0;
+static int EXPORT_DRAWING = 1;
+static int EXPORT_READY   = 2;
+static int EXPORT_BUSY    = 3;
+
+struct export_slot {
+   unsigned char *pixels;
+   int state;
+   // frames are numbered in the order they were rendered, dropped ones
+   // leave no gap
+   int sequence;
+};
+
+const char *export_path     = NULL;
+int export_frames           = 600;
+int export_threads          = 2;
+bool export_wait            = false;
+export_slot export_slots[8];
+pthread_t export_workers[16];
+pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t export_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t export_turn  = PTHREAD_COND_INITIALIZER;
+pthread_cond_t export_free  = PTHREAD_COND_INITIALIZER;
+bool export_done            = false;
+int export_sequence         = 0;
+int export_written          = 0;
+int stat_dropped            = 0;
+
+double export_time(){
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void export_fill_rect(unsigned char *pixels, float cx, float cy, float size, float r, float g, float b){
+   float ppu = (view_width < view_height ? view_width : view_height) / (2.0f * camera_scale);
+   int x0 = (int)(view_width * 0.5f + (cx - size * 0.5f) * ppu);
+   int x1 = (int)(view_width * 0.5f + (cx + size * 0.5f) * ppu);
+   int y0 = (int)(view_height * 0.5f - (cy + size * 0.5f) * ppu);
+   int y1 = (int)(view_height * 0.5f - (cy - size * 0.5f) * ppu);
+   unsigned char rgb[] = {
+      (unsigned char)(fminf(fmaxf(r, 0.0f), 1.0f) * 255.0f),
+      (unsigned char)(fminf(fmaxf(g, 0.0f), 1.0f) * 255.0f),
+      (unsigned char)(fminf(fmaxf(b, 0.0f), 1.0f) * 255.0f)};
+
+   if (x1 == x0) x1++;
+   if (y1 == y0) y1++;
+   if (x0 < 0) x0 = 0;
+   if (y0 < 0) y0 = 0;
+   if (x1 > view_width) x1 = view_width;
+   if (y1 > view_height) y1 = view_height;
+   for (int y = y0; y < y1; y++){
+      unsigned char *row = pixels + (y * view_width + x0) * 3;
+      for (int x = x0; x < x1; x++){
+         *row++ = rgb[0];
+         *row++ = rgb[1];
+         *row++ = rgb[2];
+      }
+   }
+}
+
+// flat version of draw_cells(): one square per cell (or LOD block) in
+// the colour draw_one_cell() gives it, no lighting
+void export_render(unsigned char *pixels){
+   float half_size[] = {CELLS_ARRAY_SIZE[0] * 0.5f, CELLS_ARRAY_SIZE[1] * 0.5f};
+   int level = lod_pick_level();
+   float span = (float)(1 << level);
+
+   for (int i = 0; i < view_width * view_height; i++){
+      pixels[i*3 + 0] = 0.3f * 255;
+      pixels[i*3 + 1] = 0.05f * 255;
+      pixels[i*3 + 2] = 0.6f * 255;
+   }
+
+   for (int y = 0; y < lod_size[level][1]; y++){
+      for (int x = 0; x < lod_size[level][0]; x++){
+         float cell, size;
+         if (level == 0){
+            cell = cells_main_array[x][y];
+            if (cell <= 0.0f) continue;
+            size = cell;
+         }else{
+            int i = y * lod_size[level][0] + x;
+            if (lod_count[level][i] == 0) continue;
+            cell = lod_sum[level][i] / lod_count[level][i];
+            size = cell * span * sqrtf(lod_count[level][i] / (span * span));
+         }
+         float cx = (x + 0.5f) * span - 0.5f - half_size[0];
+         float cy = (y + 0.5f) * span - 0.5f - half_size[1];
+         float shade = cell > 0.45f ? 0.45f : cell;
+         export_fill_rect(pixels, cx, cy, size, 0.4f, shade + cy*0.01f, shade + cx*0.01f);
+      }
+   }
+}
+
+void export_write(export_slot *slot){
+   int size = view_width * view_height * 3;
+
+   if (strcmp(export_path, "-") == 0){
+      fwrite(slot->pixels, 1, size, stdout);
+      return;
+   }
+
+   char name[1024];
+   snprintf(name, sizeof(name), export_path, slot->sequence);
+#ifdef CA_PNG
+   int len = strlen(name);
+   if (len > 4 and strcmp(name + len - 4, ".png") == 0){
+      png_image image;
+      memset(&image, 0, sizeof(image));
+      image.version = PNG_IMAGE_VERSION;
+      image.width = view_width;
+      image.height = view_height;
+      image.format = PNG_FORMAT_RGB;
+      if (!png_image_write_to_file(&image, name, 0, slot->pixels, 0, NULL)){
+         fprintf(stderr, "export: %s: %s\n", name, image.message);
+      }
+      return;
+   }
+#endif
+   FILE *file = fopen(name, "wb");
+   if (!file){
+      perror(name);
+      return;
+   }
+   fprintf(file, "P6\n%i %i\n255\n", view_width, view_height);
+   fwrite(slot->pixels, 1, size, file);
+   fclose(file);
+}
+
+// takes the oldest ready frame; raw stdout frames are written strictly
+// in order, files can be written in any order
+void *export_worker(void *arg){
+   bool ordered = strcmp(export_path, "-") == 0;
+
+   pthread_mutex_lock(&export_lock);
+   while (true){
+      export_slot *slot = NULL;
+      for (int i = 0; i < EXPORT_SLOTS; i++){
+         if (export_slots[i].state == EXPORT_READY and (!slot or export_slots[i].sequence < slot->sequence)){
+            slot = &export_slots[i];
+         }
+      }
+      if (!slot){
+         if (export_done) break;
+         pthread_cond_wait(&export_ready, &export_lock);
+         continue;
+      }
+      slot->state = EXPORT_BUSY;
+      if (ordered){
+         while (export_written != slot->sequence){
+            pthread_cond_wait(&export_turn, &export_lock);
+         }
+      }
+      pthread_mutex_unlock(&export_lock);
+
+      export_write(slot);
+
+      pthread_mutex_lock(&export_lock);
+      slot->state = EXPORT_FREE;
+      export_written++;
+      pthread_cond_broadcast(&export_turn);
+      pthread_cond_signal(&export_free);
+   }
+   pthread_mutex_unlock(&export_lock);
+   return NULL;
+}
+
+void export_submit(){
+   export_slot *slot = NULL;
+
+   pthread_mutex_lock(&export_lock);
+   while (!slot){
+      for (int i = 0; i < EXPORT_SLOTS and !slot; i++){
+         if (export_slots[i].state == EXPORT_FREE){
+            slot = &export_slots[i];
+            slot->state = EXPORT_DRAWING;
+         }
+      }
+      if (slot or !export_wait) break;
+      pthread_cond_wait(&export_free, &export_lock);
+   }
+   pthread_mutex_unlock(&export_lock);
+
+   if (!slot){
+      stat_dropped++;
+      return;
+   }
+
+   counters_switch(COUNTER_DRAW);
+   export_render(slot->pixels);
+   counters_switch(COUNTER_IDLE);
+
+   pthread_mutex_lock(&export_lock);
+   slot->sequence = export_sequence++;
+   slot->state = EXPORT_READY;
+   pthread_cond_signal(&export_ready);
+   pthread_mutex_unlock(&export_lock);
+}
+
+int export_run(){
+   if (export_threads < 1) export_threads = 1;
+   if (export_threads > 16) export_threads = 16;
+   for (int i = 0; i < EXPORT_SLOTS; i++){
+      export_slots[i].pixels = (unsigned char*)malloc((size_t)view_width * view_height * 3);
+      export_slots[i].state = EXPORT_FREE;
+      if (!export_slots[i].pixels){
+         fprintf(stderr, "out of memory\n");
+         return 1;
+      }
+   }
+   for (int i = 0; i < export_threads; i++){
+      pthread_create(&export_workers[i], NULL, export_worker, NULL);
+   }
+
+   if (strcmp(export_path, "-") == 0){
+      fprintf(stderr, "raw rgb24 %ix%i frames on stdout, e.g.\n"
+         "  | ffmpeg -f rawvideo -pix_fmt rgb24 -s %ix%i -r %i -i - out.mp4\n",
+         view_width, view_height, view_width, view_height, FPS);
+   }
+
+   counters_print = true;
+   init_automation();
+   double start = export_time();
+   for (int i = 0; i < export_frames; i++){
+      run_automation();
+      export_submit();
+      if ((i + 1) % 100 == 0){
+         double elapsed = export_time() - start;
+         fprintf(stderr, "FRAME: [%i/%i] FPS: [%.1f] DROPPED: [%i] ALIVE: [%i/%i]\n",
+            i + 1, export_frames, (i + 1) / elapsed, stat_dropped, stat_alive, MAX_CELLS);
+      }
+   }
+   double render_time = export_time() - start;
+
+   pthread_mutex_lock(&export_lock);
+   export_done = true;
+   pthread_cond_broadcast(&export_ready);
+   pthread_mutex_unlock(&export_lock);
+   for (int i = 0; i < export_threads; i++){
+      pthread_join(export_workers[i], NULL);
+   }
+   double total_time = export_time() - start;
+
+   fprintf(stderr, "rendered %i frames in %.2fs (%.1f fps), %i written, %i dropped, done in %.2fs\n",
+      export_frames, render_time, export_frames / render_time, export_written, stat_dropped, total_time);
+   return 0;
+}
+
 // MAIN
 // ----------------------------------------
 static float modelAmb[4] = {0.2, 0.2, 0.2, 1.0};
 
 int main(int argc, char** argv) {
+   rule = ca_rule_default(2);
+   for (int i = 1; i < argc; i++){
+      bool value = i + 1 < argc;
+      if (strcmp(argv[i], "--wait") == 0) export_wait = true;
+      else if (value and strcmp(argv[i], "--export") == 0) export_path = argv[++i];
+      else if (value and strcmp(argv[i], "--frames") == 0) export_frames = atoi(argv[++i]);
+      else if (value and strcmp(argv[i], "--threads") == 0) export_threads = atoi(argv[++i]);
+      else if (value and strcmp(argv[i], "--size") == 0) sscanf(argv[++i], "%ix%i", &view_width, &view_height);
+      else if (value and strcmp(argv[i], "--lenia") == 0){
+         rule.kind = CA_RULE_LENIA;
+         rule.lenia_radius = atoi(argv[++i]);
+      }
+      else if (value and strcmp(argv[i], "--ltl") == 0){
+         // R5,B34-45,S33-57
+         rule.kind = CA_RULE_LTL;
+         sscanf(argv[++i], "R%i,B%i-%i,S%i-%i", &rule.ltl_radius, &rule.ltl_birth[0], &rule.ltl_birth[1], &rule.ltl_survive[0], &rule.ltl_survive[1]);
+      }
+      else if (value and strcmp(argv[i], "--lenia-peaks") == 0){
+         // ring heights, e.g. 1,0.5,0.25 for three rings
+         char *peak = strtok(argv[++i], ",");
+         for (rule.lenia_rings = 0; peak and rule.lenia_rings < 8; peak = strtok(NULL, ",")){
+            rule.lenia_peaks[rule.lenia_rings++] = atof(peak);
+         }
+         if (rule.lenia_rings == 0) rule.lenia_rings = 1;
+      }
+      else if (value and strcmp(argv[i], "--telemetry") == 0){
+         if (!telemetry_start(argv[++i])) return 1;
+      }
+      else if (value and strcmp(argv[i], "--publish") == 0){
+         if (!publish_start(argv[++i], 2, CELLS_ARRAY_SIZE)) return 1;
+      }
+      else if (value and strcmp(argv[i], "--pages") == 0){
+         // normal, thp (transparent huge pages) or huge (hugetlb)
+         const char *policy = argv[++i];
+         ca_set_page_policy(strcmp(policy, "huge") == 0 ? CA_PAGES_EXPLICIT : strcmp(policy, "normal") == 0 ? CA_PAGES_NORMAL : CA_PAGES_TRANSPARENT);
+      }
+      else if (strcmp(argv[i], "--memory") == 0) show_memory = true;
+      else if (strcmp(argv[i], "--world") == 0) world_mode = true;
+      else if (value and strcmp(argv[i], "--counters") == 0){
+         counters_every = atoi(argv[++i]);
+         counters_start();
+      }
+      else if (value and strcmp(argv[i], "--rewind") == 0) rewind_budget_mb = atoi(argv[++i]);
+      else if (value and strcmp(argv[i], "--isa") == 0){
+         isa = ca_isa_from_name(argv[++i]);
+         if (isa < 0){
+            fprintf(stderr, "%s: not scalar, sse, avx2 or avx512\n", argv[i]);
+            return 1;
+         }
+      }
+      else if (value and strcmp(argv[i], "--checkpoint") == 0) checkpoint_dir = argv[++i];
+      else if (value and strcmp(argv[i], "--checkpoint-every") == 0) checkpoint_every = atoi(argv[++i]);
+      else if (value and strcmp(argv[i], "--checkpoint-keep") == 0) checkpoint_keep = atoi(argv[++i]);
+      else if (value and strcmp(argv[i], "--restore") == 0) restore_dir = argv[++i];
+      else if (value and strcmp(argv[i], "--load") == 0) load_path = argv[++i];
+      else if (value and strcmp(argv[i], "--at") == 0){
+         sscanf(argv[++i], "%i,%i", &load_at[0], &load_at[1]);
+         load_centre = false;
+      }
+   }
+   if (checkpoint_dir and !checkpoint_start(checkpoint_dir, "ca2d")){
+      return 1;
+   }
+   if (export_path){
+      return export_run();
+   }
+
    glutInit(&argc, argv);
 
    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH | GLUT_MULTISAMPLE);
@@ -9,10 +9,46 @@
 // https://github.com/w84death/cellular-automaton
 //
 // Linux:
-// gcc -Os ca3d.cpp -o ca3d.app -lglut -lGL -lGLU -lm
+// gcc -Os -fopenmp ca3d.cpp ca_engine.cpp -o ca3d.app -lglut -lGL -lGLU -lm -lpthread -lrt
 //
 // OSX:
-// gcc -o ca3d ca3d.cpp -framework GLUT -framework OpenGL
+// gcc -o ca3d ca3d.cpp ca_engine.cpp -framework GLUT -framework OpenGL
+//
+// Per-generation stats to CSV (or raw records with a .bin name):
+// ./ca3d.app --telemetry stats.csv
+//
+// Live grid in shared memory for other processes (see ca_watch.cpp):
+// ./ca3d.app --publish /ca3d
+//
+// Grid memory: huge pages (normal, thp or huge) and where they landed:
+// ./ca3d.app --pages thp --memory
+//
+// Checkpoint every 1000 generations, keep the last 3, and resume later:
+// ./ca3d.app --checkpoint ckpt --checkpoint-every 1000 --checkpoint-keep 3
+// ./ca3d.app --checkpoint ckpt --restore ckpt
+//
+// Life kernels for a given instruction set (scalar, sse, avx2, avx512),
+// the default is the best the CPU has up to avx2:
+// ./ca3d.app --isa avx512
+//
+// Cycles, IPC, cache and branch misses of the step, swap and draw phases
+// (per thread for the step), summed up in the HUD every 100 generations:
+// ./ca3d.app --counters 100
+//
+// Keep up to 256 MB of history to step back through (z/x, Z/X by ten,
+// v carries on from there; 0 turns it off):
+// ./ca3d.app --rewind 256
+//
+// Larger than Life, radius 2 box, birth 14-19, survival 12-30:
+// ./ca3d.app --ltl R2,B14-19,S12-30
+//
+// Continuous (Lenia) mode with a radius 10 kernel of two rings:
+// ./ca3d.app --lenia 10 --lenia-peaks 1,0.5
+//
+// Start from a voxel list ("x y z [value]" lines), or a Life RLE or
+// Macrocell as one layer, centred on the grid or from x,y,z:
+// ./ca3d.app --load shape.vox
+// ./ca3d.app --load glider.rle --at 4,4,18
 //
 // ----------------------------------------
 
@@ -28,8 +64,20 @@
 #include <GL/glut.h>
 #endif
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "ca_telemetry.h"
+#include "ca_scheduler.h"
+#include "ca_engine.h"
+#include "ca_publish.h"
+#include "ca_checkpoint.h"
+#include "ca_counters.h"
+#include "ca_rewind.h"
+#include "ca_import.h"
 
 // SYSTEM VARS
 // ----------------------------------------------------------------------------
@@ -42,6 +90,10 @@ int win_width         = 512;
 int win_height        = 384;
 int win_x             = 256;
 int win_y             = 100;
+float win_aspect      = (float)win_width / (float)win_height;
+int view_width        = win_width;
+int view_height       = win_height;
+bool show_info        = false;
 
 static int FPS        = 60;
 int refresh_ms        = 1000/FPS;
@@ -61,15 +113,64 @@ float cam_clear_color[4] = {0.3f, 0.05f, 0.6f, 1.0f};
 static int CELLS_ARRAY_SIZE[]    = {36, 36, 36};
 static int MAX_CELLS             = CELLS_ARRAY_SIZE[0]*CELLS_ARRAY_SIZE[1]*CELLS_ARRAY_SIZE[2];
 int half[]                        = {CELLS_ARRAY_SIZE[0] * 0.5,  CELLS_ARRAY_SIZE[1] * 0.5, CELLS_ARRAY_SIZE[2] * 0.5};
-float cells_main_array[36][36][36];
-float cells_buffer_array[36][36][36];
+// the simulation lives in ca_engine, cells_main_array is a read-only
+// view of its current generation refreshed after every step
+ca_engine *engine       = NULL;
+ca_rule rule;
+const float (*cells_main_array)[36][36];
 
 static float CELL_ALIVE = 0.2f;
 static float CELL_NEW   = 0.4f;
 static float CELL_DEAD  = 0.0f;
-static float CELL_MIN_COLOUR  = 0.2f;
-static float CELL_MAX_COLOUR  = 0.8f;
-static float CELL_STEP_COLOUR = 0.05f;
+
+int stat_iteration      = 0;
+int stat_alive          = 0;
+int stat_change         = 0;
+// life kernel ISA, page sizes and NUMA placement of the grid, filled
+// once it is allocated
+char stat_memory[256];
+bool show_memory        = false;
+int isa                 = -1;
+
+// cell drawing: cells sit every CELL_SCALE units and grow with colour
+static float CELL_SCALE       = 1.2f;
+static float CELL_BASE_SIZE   = 0.1f;
+// from this colour a cube is big enough to touch its face neighbours
+static float CELL_SOLID       = (CELL_SCALE - CELL_BASE_SIZE) / 1.5f;
+
+// visibility
+// one bit per solid face neighbour (-x +x -y +y -z +z), kept up to date
+// from the cells the step and the rewind view report; 0x3F means the
+// cell is enclosed
+unsigned char cells_face_mask[36][36][36];
+static unsigned char FACES_ALL = 0x3F;
+bool cull_mode          = true;
+int cull_list[36][36*36];
+int cull_count[36];
+int stat_drawn          = 0;
+
+// meshing: the volume is cut into 12^3 chunks, every chunk keeps one
+// merged surface mesh that is rebuilt only when its cells change
+static const int CHUNK_SIZE = 12;
+static int CHUNKS[]     = {3, 3, 3};
+static const int MESH_BLOCK_QUADS = 256;
+// a face only shows between a solid and an empty cell: at most every
+// face between two cells of a chunk, 3 n^2 (n - 1), and its 6 n^2 outer
+// ones (5616 quads, 22 blocks)
+static const int MESH_CHUNK_MAX_QUADS  = 3 * CHUNK_SIZE * CHUNK_SIZE * (CHUNK_SIZE + 1);
+static const int MESH_CHUNK_MAX_BLOCKS = (MESH_CHUNK_MAX_QUADS + MESH_BLOCK_QUADS - 1) / MESH_BLOCK_QUADS;
+bool mesh_mode          = false;
+int stat_mesh_quads     = 0;
+int stat_mesh_rebuilt   = 0;
+
+// level of detail: level n keeps one entry per 2^n cube of cells with
+// the number of alive cells and the sum of their colours
+static int LOD_MAX_LEVELS = 8;
+int lod_levels          = 1;
+int lod_size[8][3];
+int *lod_count[8];
+double *lod_sum[8];
+int stat_lod_level      = 0;
 
 int STATE               = 0;
 static int S_INT        = 0;
@@ -96,14 +197,24 @@ void draw_floor();
 void fullscreen_toggle();
 void mouse();
 void special_keys();
-void simulation_loop();
+bool simulation_loop();
 void simulation_setup();
 void simulation_draw();
 void simulation_draw_cell();
-void simulation_count_neigbours();
-void simulationcell_gain_colour();
-void simulationcell_lose_colour();
-void simulation_do_work();
+void simulation_update_faces();
+void simulation_cull();
+void simulation_restore();
+void simulation_load();
+void simulation_changed();
+void simulation_view_changed(void *user, int x, int y, int z, float old_cell, float new_cell);
+void simulation_update_view();
+void mesh_reset();
+void mesh_track();
+void mesh_build_chunk();
+void mesh_draw();
+void lod_setup();
+void lod_reset();
+void lod_update();
 
 
 
@@ -122,41 +233,318 @@ void simulation_do_work();
 
 
 
-float random_f(){
-   float r = (float)rand() / (float)RAND_MAX;
-   return r;
+
+
+
+// MESHING
+// ----------------------------------------------------------------------------
+
+struct mesh_vertex {
+  float r, g, b, a;
+  float nx, ny, nz;
+  float x, y, z;
+};
+
+struct mesh_chunk {
+  bool dirty;
+  int quads;
+  int block_count;
+  int blocks[MESH_CHUNK_MAX_BLOCKS];
+};
+
+// every chunk takes fixed-size blocks of quads from one shared pool and
+// gives them back before it is rebuilt, so steady state allocates nothing
+mesh_vertex *mesh_pool  = NULL;
+int mesh_pool_blocks    = 0;
+int *mesh_free_blocks   = NULL;
+int mesh_free_count     = 0;
+mesh_chunk mesh_chunks[3][3][3];
+unsigned char mesh_keys[36][36][36];
+
+// what a cell looks like in the mesh: 0 is empty, anything else is the
+// shade of the cube in 1/100 steps (the colour gradient comes from the
+// position and is interpolated over merged faces)
+unsigned char mesh_key(float c){
+  if (c <= CELL_ALIVE) return 0;
+  float s = CELL_BASE_SIZE + c*1.5f;
+  if (s > 0.45f) s = 0.45f;
+  return 1 + (unsigned char)(s * 100.0f + 0.5f);
 }
 
-float random_fcolor(){
-   float r = random_f();
-   if (r < CELL_MIN_COLOUR){
-      r = 0.0f;
-   }
-   if  (r > CELL_MAX_COLOUR){
-      r = CELL_MAX_COLOUR;
-   }
-   return r;
+// -1 when the pool cannot grow
+int mesh_alloc_block(){
+  if (mesh_free_count == 0){
+    int grow = mesh_pool_blocks < 16 ? 16 : mesh_pool_blocks;
+    mesh_vertex *pool = (mesh_vertex*)realloc(mesh_pool, (size_t)(mesh_pool_blocks + grow) * MESH_BLOCK_QUADS * 4 * sizeof(mesh_vertex));
+    if (!pool) return -1;
+    mesh_pool = pool;
+    int *free_blocks = (int*)realloc(mesh_free_blocks, (size_t)(mesh_pool_blocks + grow) * sizeof(int));
+    if (!free_blocks) return -1;
+    mesh_free_blocks = free_blocks;
+    for (int i = 0; i < grow; i++){
+      mesh_free_blocks[mesh_free_count++] = mesh_pool_blocks + i;
+    }
+    mesh_pool_blocks += grow;
+  }
+  return mesh_free_blocks[--mesh_free_count];
 }
 
+void mesh_release_chunk(mesh_chunk *chunk){
+  for (int i = 0; i < chunk->block_count; i++){
+    mesh_free_blocks[mesh_free_count++] = chunk->blocks[i];
+  }
+  stat_mesh_quads -= chunk->quads;
+  chunk->block_count = 0;
+  chunk->quads = 0;
+}
 
+void mesh_mark_dirty(int cx, int cy, int cz){
+  if (cx < 0 or cy < 0 or cz < 0 or cx >= CHUNKS[0] or cy >= CHUNKS[1] or cz >= CHUNKS[2]) return;
+  mesh_chunks[cx][cy][cz].dirty = true;
+}
 
+// called from the step for every cell, a chunk only gets dirty when a
+// cell appears, disappears or changes shade; cells on the chunk border
+// also dirty the neighbour chunk since its faces may show or hide
+void mesh_track(int x, int y, int z, float new_cell){
+  unsigned char key = mesh_key(new_cell);
+  if (key == mesh_keys[x][y][z]) return;
+  mesh_keys[x][y][z] = key;
+
+  int cx = x / CHUNK_SIZE, cy = y / CHUNK_SIZE, cz = z / CHUNK_SIZE;
+  mesh_mark_dirty(cx, cy, cz);
+  if (x % CHUNK_SIZE == 0) mesh_mark_dirty(cx-1, cy, cz);
+  if (x % CHUNK_SIZE == CHUNK_SIZE-1) mesh_mark_dirty(cx+1, cy, cz);
+  if (y % CHUNK_SIZE == 0) mesh_mark_dirty(cx, cy-1, cz);
+  if (y % CHUNK_SIZE == CHUNK_SIZE-1) mesh_mark_dirty(cx, cy+1, cz);
+  if (z % CHUNK_SIZE == 0) mesh_mark_dirty(cx, cy, cz-1);
+  if (z % CHUNK_SIZE == CHUNK_SIZE-1) mesh_mark_dirty(cx, cy, cz+1);
+}
 
+void mesh_reset(){
+  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+    mesh_keys[x][y][z] = mesh_key(cells_main_array[x][y][z]);
+  }}}
+  for (int cx = 0; cx < CHUNKS[0]; cx++){
+  for (int cy = 0; cy < CHUNKS[1]; cy++){
+  for (int cz = 0; cz < CHUNKS[2]; cz++){
+    mesh_chunks[cx][cy][cz].dirty = true;
+  }}}
+}
 
+unsigned char mesh_key_at(int *p){
+  if (p[0] < 0 or p[1] < 0 or p[2] < 0) return 0;
+  if (p[0] >= CELLS_ARRAY_SIZE[0] or p[1] >= CELLS_ARRAY_SIZE[1] or p[2] >= CELLS_ARRAY_SIZE[2]) return 0;
+  return mesh_keys[p[0]][p[1]][p[2]];
+}
 
+// corners in grid units (cell centres are whole numbers), normal along axis d
+void mesh_emit_quad(mesh_chunk *chunk, float corners[4][3], int d, int dir, unsigned char key){
+  if (chunk->quads == chunk->block_count * MESH_BLOCK_QUADS){
+    // MESH_CHUNK_MAX_BLOCKS always fits a chunk, so only memory runs out
+    int block = mesh_alloc_block();
+    if (block < 0){
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    chunk->blocks[chunk->block_count++] = block;
+  }
+  int block = chunk->blocks[chunk->quads / MESH_BLOCK_QUADS];
+  mesh_vertex *v = mesh_pool + ((size_t)block * MESH_BLOCK_QUADS + chunk->quads % MESH_BLOCK_QUADS) * 4;
+  float shade = (key - 1) * 0.01f;
+
+  for (int i = 0; i < 4; i++){
+    v[i].x = (corners[i][0] - half[0]) * CELL_SCALE;
+    v[i].y = (corners[i][1] - half[1]) * CELL_SCALE;
+    v[i].z = (corners[i][2] - half[2]) * CELL_SCALE;
+    // same gradient as simulation_draw_cell()
+    v[i].r = shade + v[i].z*0.04f;
+    v[i].g = shade + v[i].x*0.04f;
+    v[i].b = shade + v[i].y*0.04f;
+    v[i].a = 1.0f;
+    v[i].nx = d == 0 ? dir : 0.0f;
+    v[i].ny = d == 1 ? dir : 0.0f;
+    v[i].nz = d == 2 ? dir : 0.0f;
+  }
+  chunk->quads++;
+}
 
+// greedy meshing: for each axis and direction, sweep the chunk slice by
+// slice, mark visible faces and merge runs of equal faces into rectangles
+void mesh_build_chunk(int cx, int cy, int cz){
+  mesh_chunk *chunk = &mesh_chunks[cx][cy][cz];
+  int origin[] = {cx * CHUNK_SIZE, cy * CHUNK_SIZE, cz * CHUNK_SIZE};
+  unsigned char mask[CHUNK_SIZE*CHUNK_SIZE];
+
+  mesh_release_chunk(chunk);
+
+  for (int d = 0; d < 3; d++){
+  for (int dir = -1; dir <= 1; dir += 2){
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+
+    for (int i = 0; i < CHUNK_SIZE; i++){
+      int p[3], q[3];
+
+      for (int b = 0; b < CHUNK_SIZE; b++){
+      for (int a = 0; a < CHUNK_SIZE; a++){
+        p[d] = origin[d] + i; p[u] = origin[u] + a; p[v] = origin[v] + b;
+        q[0] = p[0]; q[1] = p[1]; q[2] = p[2];
+        q[d] += dir;
+        unsigned char key = mesh_key_at(p);
+        mask[b*CHUNK_SIZE + a] = (key and !mesh_key_at(q)) ? key : 0;
+      }}
+
+      for (int b = 0; b < CHUNK_SIZE; b++){
+      for (int a = 0; a < CHUNK_SIZE; ){
+        unsigned char key = mask[b*CHUNK_SIZE + a];
+        if (!key){
+          a++;
+          continue;
+        }
+        int w = 1;
+        while (a + w < CHUNK_SIZE and mask[b*CHUNK_SIZE + a + w] == key) w++;
+        int h = 1;
+        bool grow = true;
+        while (grow and b + h < CHUNK_SIZE){
+          for (int k = 0; k < w; k++){
+            if (mask[(b+h)*CHUNK_SIZE + a + k] != key){
+              grow = false;
+              break;
+            }
+          }
+          if (grow) h++;
+        }
+        for (int hb = 0; hb < h; hb++){
+          memset(&mask[(b+hb)*CHUNK_SIZE + a], 0, w);
+        }
 
+        float plane = origin[d] + i + dir*0.5f;
+        float u0 = origin[u] + a - 0.5f, u1 = u0 + w;
+        float v0 = origin[v] + b - 0.5f, v1 = v0 + h;
+        float corners[4][3];
+        float uv[4][2] = {{u0, v0}, {u1, v0}, {u1, v1}, {u0, v1}};
+        for (int k = 0; k < 4; k++){
+          // flip the winding for faces looking down the axis
+          int n = dir > 0 ? k : 3 - k;
+          corners[k][d] = plane;
+          corners[k][u] = uv[n][0];
+          corners[k][v] = uv[n][1];
+        }
+        mesh_emit_quad(chunk, corners, d, dir, key);
+        a += w;
+      }}
+    }
+  }}
 
+  stat_mesh_quads += chunk->quads;
+  chunk->dirty = false;
+}
 
+void mesh_draw(){
+  stat_mesh_rebuilt = 0;
 
+  glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+  glEnable(GL_COLOR_MATERIAL);
 
+  for (int cx = 0; cx < CHUNKS[0]; cx++){
+  for (int cy = 0; cy < CHUNKS[1]; cy++){
+  for (int cz = 0; cz < CHUNKS[2]; cz++){
+    mesh_chunk *chunk = &mesh_chunks[cx][cy][cz];
+    if (chunk->dirty){
+      mesh_build_chunk(cx, cy, cz);
+      stat_mesh_rebuilt++;
+    }
+    for (int i = 0; i < chunk->block_count; i++){
+      int quads = chunk->quads - i * MESH_BLOCK_QUADS;
+      if (quads > MESH_BLOCK_QUADS) quads = MESH_BLOCK_QUADS;
+      glInterleavedArrays(GL_C4F_N3F_V3F, 0, mesh_pool + (size_t)chunk->blocks[i] * MESH_BLOCK_QUADS * 4);
+      glDrawArrays(GL_QUADS, 0, quads * 4);
+    }
+  }}}
 
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
 
+// LEVEL OF DETAIL
+// ----------------------------------------------------------------------------
 
+void lod_setup(){
+  int size[] = {CELLS_ARRAY_SIZE[0], CELLS_ARRAY_SIZE[1], CELLS_ARRAY_SIZE[2]};
 
+  for (int i = 0; i < 3; i++){
+    lod_size[0][i] = size[i];
+  }
+  lod_levels = 1;
+  while ((size[0] > 1 or size[1] > 1 or size[2] > 1) and lod_levels < LOD_MAX_LEVELS){
+    for (int i = 0; i < 3; i++){
+      size[i] = (size[i] + 1) / 2;
+      lod_size[lod_levels][i] = size[i];
+    }
+    lod_count[lod_levels] = (int*)calloc(size[0] * size[1] * size[2], sizeof(int));
+    lod_sum[lod_levels] = (double*)calloc(size[0] * size[1] * size[2], sizeof(double));
+    lod_levels++;
+  }
+}
 
+int lod_index(int l, int x, int y, int z){
+  return ((x >> l) * lod_size[l][1] + (y >> l)) * lod_size[l][2] + (z >> l);
+}
 
+// moves one cell from old to new colour in every level above the grid,
+// only cells that would be drawn (> CELL_ALIVE) are counted
+void lod_update(int x, int y, int z, float old_cell, float new_cell){
+  bool was_alive = old_cell > CELL_ALIVE;
+  bool is_alive = new_cell > CELL_ALIVE;
+  float colour = (is_alive ? new_cell : 0.0f) - (was_alive ? old_cell : 0.0f);
+
+  if (!was_alive and !is_alive) return;
+  for (int l = 1; l < lod_levels; l++){
+    int i = lod_index(l, x, y, z);
+    lod_count[l][i] += is_alive - was_alive;
+    lod_sum[l][i] += colour;
+    if (lod_count[l][i] == 0){
+      lod_sum[l][i] = 0.0f;
+    }
+  }
+}
 
+void lod_reset(){
+  for (int l = 1; l < lod_levels; l++){
+    int size = lod_size[l][0] * lod_size[l][1] * lod_size[l][2];
+    memset(lod_count[l], 0, size * sizeof(int));
+    memset(lod_sum[l], 0, size * sizeof(double));
+  }
+  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+    lod_update(x, y, z, CELL_DEAD, cells_main_array[x][y][z]);
+  }}}
+}
 
+// first level where one block is at least a pixel tall at the distance
+// of the nearest point of the volume
+int lod_pick_level(){
+  float box[3], d[3];
+  for (int i = 0; i < 3; i++){
+    box[i] = half[i] * CELL_SCALE;
+    d[i] = fabsf(cam_pos[i+3]) - box[i];
+    if (d[i] < 0.0f) d[i] = 0.0f;
+  }
+  float dist = sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+  if (dist < 0.1f) return 0;
+
+  float cell_pixels = view_height * CELL_SCALE / (2.0f * dist * tanf(FOV * 0.5f * M_PI / 180.0f));
+  int level = 0;
+  while (level < lod_levels - 1 and cell_pixels * (1 << level) < 1.0f){
+    level++;
+  }
+  return level;
+}
 
 // SIMULATION
 // ----------------------------------------------------------------------------
@@ -178,125 +566,270 @@ void simulation_draw_cell(float s, float x, float y, float z, float c){
 }
 
 void simulation_setup(){
-  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
-  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-    cells_main_array[x][y][z] = CELL_DEAD;
-    if (z>CELLS_ARRAY_SIZE[2]*0.20 and z < CELLS_ARRAY_SIZE[2]*0.80){
-    if (y>CELLS_ARRAY_SIZE[1]*0.20 and y < CELLS_ARRAY_SIZE[1]*0.80){
-    if (x>CELLS_ARRAY_SIZE[0]*0.20 and x < CELLS_ARRAY_SIZE[0]*0.80){
-      cells_main_array[x][y][z] = (random_f() > 0.85) ? random_fcolor() : CELL_DEAD;  
-    }}}
+  rewind_edit_begin(engine, simulation_view_changed, NULL);
+  ca_fill_random(engine);
+  rewind_edit_end(engine);
+  simulation_update_view();
+  simulation_update_faces();
+  mesh_reset();
+  lod_reset();
+  publish_frame(ca_cells(engine), ca_get_stats(engine));
+}
+
+// a pattern file in place of the random fill; centred on the grid unless
+// at is given
+void simulation_load(const char *path, const int *at){
+  int centre[] = {CELLS_ARRAY_SIZE[0] / 2, CELLS_ARRAY_SIZE[1] / 2, CELLS_ARRAY_SIZE[2] / 2};
+  import_target target;
+  rewind_edit_begin(engine, simulation_view_changed, NULL);
+  // live cells get the colour of a newborn one
+  if (!import_into_engine(engine, path, at ? at : centre, at == NULL, 0.4f, &target)){
+    exit(1);
+  }
+  rewind_edit_end(engine);
+  fprintf(stderr, "%s: %ix%ix%i, %li cells placed\n", path, target.size[0], target.size[1], target.size[2], target.cells);
+  simulation_update_view();
+  simulation_update_faces();
+  mesh_reset();
+  lod_reset();
+  publish_frame(ca_cells(engine), ca_get_stats(engine));
+}
+
+// continues the run saved in the newest checkpoint
+void simulation_restore(const char *dir){
+  rewind_edit_begin(engine, simulation_view_changed, NULL);
+  if (!checkpoint_restore(engine, dir, "ca3d")){
+    exit(1);
+  }
+  rewind_edit_end(engine);
+  rule = *ca_get_rule(engine);
+  simulation_update_view();
+  simulation_update_faces();
+  mesh_reset();
+  lod_reset();
+  publish_frame(ca_cells(engine), ca_get_stats(engine));
+}
+
+void lod_draw(int level){
+  int span = 1 << level;
+  float cells = (float)(span * span * span);
+
+  for (int x = 0; x < lod_size[level][0]; x++){
+  for (int y = 0; y < lod_size[level][1]; y++){
+  for (int z = 0; z < lod_size[level][2]; z++){
+    int i = (x * lod_size[level][1] + y) * lod_size[level][2] + z;
+    int count = lod_count[level][i];
+    if (count == 0) continue;
+    float c = lod_sum[level][i] / count;
+    // keep the volume of the alive cells in the block
+    float s = (CELL_BASE_SIZE + c*1.5f) * span * cbrtf(count / cells);
+    simulation_draw_cell(s,
+      (x * span + (span - 1) * 0.5f - half[0]) * CELL_SCALE,
+      (y * span + (span - 1) * 0.5f - half[1]) * CELL_SCALE,
+      (z * span + (span - 1) * 0.5f - half[2]) * CELL_SCALE, c);
+    stat_drawn++;
   }}}
 }
 
+// builds cull_list with the cells worth drawing: alive, not enclosed by
+// solid face neighbours, inside the view frustum and before the fog end
+void simulation_cull(){
+  float eye[3], f[3], r[3], u[3];
+  float len;
+
+  for (int i = 0; i < 3; i++){
+    eye[i] = cam_pos[i+3];
+    f[i] = cam_look_pos[i+3] - cam_pos[i+3];
+  }
+  len = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+  if (len < 0.0001f) len = 0.0001f;
+  f[0] /= len; f[1] /= len; f[2] /= len;
+
+  // right = f x up(0,1,0), up = right x f, same as gluLookAt
+  r[0] = -f[2]; r[1] = 0.0f; r[2] = f[0];
+  len = sqrtf(r[0]*r[0] + r[2]*r[2]);
+  if (len < 0.0001f) { r[0] = 1.0f; r[2] = 0.0f; len = 1.0f; }
+  r[0] /= len; r[2] /= len;
+  u[0] = r[1]*f[2] - r[2]*f[1];
+  u[1] = r[2]*f[0] - r[0]*f[2];
+  u[2] = r[0]*f[1] - r[1]*f[0];
+
+  float tan_y = tanf(FOV * 0.5f * M_PI / 180.0f);
+  float tan_x = tan_y * win_aspect;
+  float grow_y = sqrtf(1.0f + tan_y*tan_y);
+  float grow_x = sqrtf(1.0f + tan_x*tan_x);
+  float far = cam_fog_size < 100.0f ? cam_fog_size : 100.0f;
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+    int count = 0;
+    for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+    for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+      float c = cells_main_array[x][y][z];
+      if (c <= CELL_ALIVE) continue;
+      if (cull_mode){
+        if (cells_face_mask[x][y][z] == FACES_ALL) continue;
+
+        float v[3] = {(x - half[0]) * CELL_SCALE - eye[0],
+                      (y - half[1]) * CELL_SCALE - eye[1],
+                      (z - half[2]) * CELL_SCALE - eye[2]};
+        // bounding sphere of the cube
+        float radius = (CELL_BASE_SIZE + c*1.5f) * 0.87f;
+        float depth = v[0]*f[0] + v[1]*f[1] + v[2]*f[2];
+        if (depth + radius < 0.1f or depth - radius > far) continue;
+        float side = v[0]*r[0] + v[1]*r[1] + v[2]*r[2];
+        if (fabsf(side) > depth*tan_x + radius*grow_x) continue;
+        float up = v[0]*u[0] + v[1]*u[1] + v[2]*u[2];
+        if (fabsf(up) > depth*tan_y + radius*grow_y) continue;
+      }
+      cull_list[z][count++] = x * CELLS_ARRAY_SIZE[1] + y;
+    }}
+    cull_count[z] = count;
+  }
+}
+
 void simulation_draw(){
   float c;
-  float scale = 1.2f;
-  float size = 0.1f;
   float new_x, new_y, new_z, new_c, new_s;
 
+  if (mesh_mode){
+    mesh_draw();
+    return;
+  }
+
+  stat_drawn = 0;
+  stat_lod_level = lod_pick_level();
+  if (stat_lod_level > 0){
+    lod_draw(stat_lod_level);
+    return;
+  }
+
+  simulation_cull();
+
   for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
-  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+  for (int i = 0; i < cull_count[z]; i++){
+    int x = cull_list[z][i] / CELLS_ARRAY_SIZE[1];
+    int y = cull_list[z][i] % CELLS_ARRAY_SIZE[1];
     c = cells_main_array[x][y][z];
-    if ( c > CELL_ALIVE){
-      new_x = (x - half[0]) * scale;
-      new_y = (y - half[1]) * scale;
-      new_z = (z - half[2]) * scale;
-      new_c = (float)c;
-      new_s = (size + (c*1.5)); // + (sin(x*y) * 0.1);
-      simulation_draw_cell(new_s, new_x, new_y, new_z, new_c);
-    }
-  }}}
+    new_x = (x - half[0]) * CELL_SCALE;
+    new_y = (y - half[1]) * CELL_SCALE;
+    new_z = (z - half[2]) * CELL_SCALE;
+    new_c = (float)c;
+    new_s = (CELL_BASE_SIZE + (c*1.5)); // + (sin(x*y) * 0.1);
+    simulation_draw_cell(new_s, new_x, new_y, new_z, new_c);
+    stat_drawn++;
+  }}
 }
 
 
-float simulation_cell_gain_colour(float colour){
-   float new_colour = colour + CELL_STEP_COLOUR;
-   if (new_colour > CELL_MAX_COLOUR){
-      new_colour = CELL_MAX_COLOUR;
-   }
-   return new_colour;
+static void simulation_face_bit(unsigned char *mask, unsigned char bit, bool solid){
+  *mask = solid ? *mask | bit : *mask & ~bit;
 }
 
-float simulation_cell_lose_colour(float colour){
-   float new_colour = colour - CELL_STEP_COLOUR;
-   if (new_colour < CELL_MIN_COLOUR){
-      new_colour = CELL_MIN_COLOUR;
-   }
-   return new_colour;
-}
-
-int simulation_count_neigbours(int cx, int cy, int cz, float treshold){
-  int neigbours = 0;
-
-  for (int z = cz-1; z <= cz+1; z++){
-  for (int y = cy-1; y <= cy+1; y++){
-  for (int x = cx-1; x <= cx+1; x++){
-    if (x >= 0 and y >= 0 and z >= 0 and x < CELLS_ARRAY_SIZE[0] and y < CELLS_ARRAY_SIZE[1] and z < CELLS_ARRAY_SIZE[2]){
-      if(!( x == cx and y == cy and z == cz)){
-      if(!(z==cz-1 and y==cy-1 and x==cx-1)){
-      if(!(z==cz-1 and y==cy-1 and x==cx+1)){
-      if(!(z==cz-1 and y==cy+1 and x==cx-1)){
-      if(!(z==cz-1 and y==cy+1 and x==cx+1)){
-      if(!(z==cz+1 and y==cy-1 and x==cx-1)){
-      if(!(z==cz+1 and y==cy-1 and x==cx+1)){
-      if(!(z==cz+1 and y==cy+1 and x==cx-1)){
-      if(!(z==cz+1 and y==cy+1 and x==cx+1)){ // am I crazy already?
-      if (cells_main_array[x][y][z] >= treshold){
-        neigbours++;
-      }}}}}}}}}}
-    }
-  }}}
+// one cell became solid or stopped being solid: its six neighbours gain
+// or lose the bit of the face towards it
+void simulation_track_faces(int x, int y, int z, float old_cell, float new_cell){
+  bool solid = new_cell >= CELL_SOLID;
+  if (solid == (old_cell >= CELL_SOLID)) return;
+  if (x > 0) simulation_face_bit(&cells_face_mask[x-1][y][z], 0x02, solid);
+  if (x < CELLS_ARRAY_SIZE[0]-1) simulation_face_bit(&cells_face_mask[x+1][y][z], 0x01, solid);
+  if (y > 0) simulation_face_bit(&cells_face_mask[x][y-1][z], 0x08, solid);
+  if (y < CELLS_ARRAY_SIZE[1]-1) simulation_face_bit(&cells_face_mask[x][y+1][z], 0x04, solid);
+  if (z > 0) simulation_face_bit(&cells_face_mask[x][y][z-1], 0x20, solid);
+  if (z < CELLS_ARRAY_SIZE[2]-1) simulation_face_bit(&cells_face_mask[x][y][z+1], 0x10, solid);
+}
 
-  return neigbours;
+// the engine reports every cell that changed while it swaps buffers
+// and the rewind view for every cell it changes
+void simulation_view_changed(void *user, int x, int y, int z, float old_cell, float new_cell){
+  simulation_track_faces(x, y, z, old_cell, new_cell);
+  mesh_track(x, y, z, new_cell);
+  lod_update(x, y, z, old_cell, new_cell);
 }
 
-void simulation_do_work(){
-   int neigbours;
-   float cell;
-   float new_cell;
+void simulation_changed(void *user, int x, int y, int z, float old_cell, float new_cell){
+  rewind_record(x, y, z, old_cell);
+  simulation_view_changed(user, x, y, z, old_cell, new_cell);
+}
 
-  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
-  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-    neigbours = simulation_count_neigbours(x, y, z, CELL_ALIVE);
-    cell = cells_main_array[x][y][z];
-    if (cell > CELL_ALIVE){
-      if (neigbours < 2 or neigbours > 6){
-         new_cell = simulation_cell_lose_colour(cell);
-      }else{
-         new_cell = simulation_cell_gain_colour(cell);
-      }
-    }else{
-        if (neigbours == 5 ){
-           new_cell = simulation_cell_gain_colour(cell);
-        }else{
-           new_cell = CELL_DEAD;
-        }
-     }
-    cells_buffer_array[x][y][z] = new_cell;
-  }}}
+// the engine's grid, or the generation on view while rewound
+void simulation_update_view(){
+  cells_main_array = (const float (*)[36][36])rewind_cells(engine);
+  rewind_stats(engine, &stat_iteration, &stat_alive, &stat_change);
 }
 
+void simulation_change_rule(){
+  if (!ca_set_rule(engine, &rule)){
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  rule = *ca_get_rule(engine);
+}
 
-void simulation_swap_arrays(){
-  float old_cell;
-  float new_cell;
+void simulation_create(){
+  engine = ca_create(3, CELLS_ARRAY_SIZE, &rule);
+  if (!engine){
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  ca_set_isa(engine, isa);
+  ca_set_change_hook(engine, simulation_changed, NULL);
+  if (counters_on) ca_set_phase_hook(engine, counters_engine_phase, NULL);
+  ca_set_detailed_stats(engine, telemetry_file != NULL);
+  int used = snprintf(stat_memory, sizeof(stat_memory), "ISA: [%s] ", ca_isa_name(ca_get_isa(engine)));
+  ca_memory_report(engine, stat_memory + used, sizeof(stat_memory) - used);
+  if (show_memory){
+    fprintf(stderr, "%s\n", stat_memory);
+  }
+}
 
-  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
-  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
-  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
-    old_cell = cells_main_array[x][y][z];
-    new_cell = cells_buffer_array[x][y][z];
-    cells_main_array[x][y][z] = new_cell;
+// the whole face mask from the grid on view, after it was replaced
+// (setup, load, restore); every cell gathers its own six neighbours, so
+// the slabs of x go to threads without sharing a byte. simulation_cull()
+// uses the mask to skip cells that are boxed in from all six sides.
+void simulation_update_faces(){
+  int w = CELLS_ARRAY_SIZE[0], h = CELLS_ARRAY_SIZE[1], d = CELLS_ARRAY_SIZE[2];
+
+  #pragma omp parallel for
+  for (int x = 0; x < w; x++){
+  for (int y = 0; y < h; y++){
+  for (int z = 0; z < d; z++){
+    unsigned char mask = 0;
+    if (x > 0 and cells_main_array[x-1][y][z] >= CELL_SOLID) mask |= 0x01;
+    if (x < w-1 and cells_main_array[x+1][y][z] >= CELL_SOLID) mask |= 0x02;
+    if (y > 0 and cells_main_array[x][y-1][z] >= CELL_SOLID) mask |= 0x04;
+    if (y < h-1 and cells_main_array[x][y+1][z] >= CELL_SOLID) mask |= 0x08;
+    if (z > 0 and cells_main_array[x][y][z-1] >= CELL_SOLID) mask |= 0x10;
+    if (z < d-1 and cells_main_array[x][y][z+1] >= CELL_SOLID) mask |= 0x20;
+    cells_face_mask[x][y][z] = mask;
   }}}
 }
 
-void simulation_loop(){
-  simulation_do_work();
-  simulation_swap_arrays();
+// steps the view through the history (negative is back)
+void simulation_rewind(int generations){
+  rewind_step(engine, generations, simulation_view_changed, NULL);
+  simulation_update_view();
+}
+
+// carries on from the generation on view
+void simulation_resume(){
+  rewind_resume(engine);
+  simulation_update_view();
+  publish_frame(ca_cells(engine), ca_get_stats(engine));
+}
+
+// false when no generation ran
+bool simulation_loop(){
+  // paused while looking back
+  if (rewind_viewing) return false;
+  ca_step(engine, 1);
+  rewind_tick(engine);
+  simulation_update_view();
+  telemetry_push(ca_get_stats(engine));
+  publish_frame(ca_cells(engine), ca_get_stats(engine));
+  checkpoint_tick(engine);
+  counters_tick();
+  return true;
 }
 
 
@@ -385,6 +918,42 @@ void keyboard(unsigned char key, int x, int y) {
       case 13: // enter
 
          break;
+      case 99: // c
+        cull_mode = !cull_mode;
+        break;
+      case 105: // i
+        show_info = !show_info;
+        break;
+      case 103: // g
+        sched_next_mode();
+        break;
+      case 91: // [
+        sched_change_target(0.5f);
+        break;
+      case 93: // ]
+        sched_change_target(2.0f);
+        break;
+      case 108: // l
+        rule.kind = rule.kind == CA_RULE_LENIA ? CA_RULE_LIFE : CA_RULE_LENIA;
+        simulation_change_rule();
+        simulation_setup();
+        break;
+      case 116: // t
+        rule.kind = rule.kind == CA_RULE_LTL ? CA_RULE_LIFE : CA_RULE_LTL;
+        simulation_change_rule();
+        simulation_setup();
+        break;
+      case 44: // ,
+        rule.lenia_radius--;
+        simulation_change_rule();
+        break;
+      case 46: // .
+        rule.lenia_radius++;
+        simulation_change_rule();
+        break;
+      case 109: // m
+        mesh_mode = !mesh_mode;
+        break;
       case 113: // q
         if(fabs(cam_pos[1]-cam_pos[4]) < cam_speed ){
           cam_pos[1] += cam_speed;
@@ -422,6 +991,21 @@ void keyboard(unsigned char key, int x, int y) {
           cam_look_pos[2] += cam_speed;
         }
         break;
+      case 122: // z
+        simulation_rewind(-1);
+        break;
+      case 120: // x
+        simulation_rewind(1);
+        break;
+      case 90: // Z
+        simulation_rewind(-10);
+        break;
+      case 88: // X
+        simulation_rewind(10);
+        break;
+      case 118: // v
+        simulation_resume();
+        break;
    }
 }
 
@@ -441,6 +1025,9 @@ void reshape(GLsizei width, GLsizei height) {
   if (height == 0) height = 12;
 
   glViewport(0, 0, width, height);
+  win_aspect = (float)width / (float)height;
+  view_width = width;
+  view_height = height;
   glMatrixMode (GL_PROJECTION);
   glLoadIdentity ();
   gluPerspective (FOV, (GLfloat)width/(GLfloat)height, 0.1f, 100.0f);
@@ -535,6 +1122,59 @@ void camera_move(){
     0.0, 1.0, 0.0);
 }
 
+void draw_text(int x, int y, const char *text){
+  glRasterPos2i(x, y);
+  for (const char *c = text; *c; c++){
+    glutBitmapCharacter(GLUT_BITMAP_9_BY_15, *c);
+  }
+}
+
+void draw_stats(){
+  char buf[256];
+
+  glPushAttrib(GL_ENABLE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_FOG);
+  glDisable(GL_DEPTH_TEST);
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0, view_width, 0, view_height);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor3f(1.0f, 1.0f, 1.0f);
+  snprintf(buf, sizeof(buf), "ITERATION: [%i] ALIVE: [%i/%i] CHANGE: [%i] DRAWN: [%i] LOD: [%i]",
+    stat_iteration, stat_alive, MAX_CELLS, stat_change, stat_drawn, stat_lod_level);
+  draw_text(10, 10, buf);
+  snprintf(buf, sizeof(buf), "SCHEDULER: [%s %.0f] GEN/S: [%.1f] FRAME: [%.1fms]",
+    SCHED_NAMES[sched_mode], sched_target, stat_gens_per_sec, stat_frame_ms);
+  draw_text(10, 28, buf);
+  draw_text(10, 46, stat_memory);
+  int line = 64;
+  if (counters_on){
+    draw_text(10, line, stat_counters[0]);
+    draw_text(10, line + 18, stat_counters[1]);
+    line += 36;
+  }
+  if (mesh_mode){
+    snprintf(buf, sizeof(buf), "MESH: [%i quads] REBUILT: [%i chunks]", stat_mesh_quads, stat_mesh_rebuilt);
+    draw_text(10, line, buf);
+    line += 18;
+  }
+  if (rewind_on){
+    rewind_status(buf, sizeof(buf));
+    draw_text(10, line, buf);
+  }
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopAttrib();
+}
+
 void setup_scene(){
   setup_lighting();
   STATE = S_SIMULATION;
@@ -557,6 +1197,8 @@ void setup_scene(){
 // ----------------------------------------------------------------------------
 
 void display() {
+  sched_draw_begin();
+  counters_switch(COUNTER_DRAW);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glClearColor(0.3f, 0.05f, 0.6f, 1.0f);
 
@@ -566,22 +1208,102 @@ void display() {
   if (STATE == S_SIMULATION){
     simulation_draw();
   }
+  if (show_info){
+    draw_stats();
+  }
 
+  glFinish();
+  counters_switch(COUNTER_IDLE);
+  sched_draw_end();
   glutSwapBuffers();
 }
 
 void render_loop(int value) {
-  simulation_loop();
-  glutPostRedisplay();
-  glutTimerFunc(refresh_ms, render_loop, 0);
+  if (sched_run(simulation_loop, refresh_ms)){
+    glutPostRedisplay();
+  }
+  glutTimerFunc(sched_delay(refresh_ms), render_loop, 0);
 }
 
 int main(int argc, char** argv) {
+  const char *restore_dir = NULL;
+  const char *load_path = NULL;
+  int load_at[3];
+  bool load_centre = true;
+  rule = ca_rule_default(3);
+  for (int i = 1; i < argc; i++){
+    bool value = i + 1 < argc;
+    if (value and strcmp(argv[i], "--telemetry") == 0){
+      if (!telemetry_start(argv[++i])) return 1;
+    }
+    else if (value and strcmp(argv[i], "--publish") == 0){
+      if (!publish_start(argv[++i], 3, CELLS_ARRAY_SIZE)) return 1;
+    }
+    else if (value and strcmp(argv[i], "--pages") == 0){
+      // normal, thp (transparent huge pages) or huge (hugetlb)
+      const char *policy = argv[++i];
+      ca_set_page_policy(strcmp(policy, "huge") == 0 ? CA_PAGES_EXPLICIT : strcmp(policy, "normal") == 0 ? CA_PAGES_NORMAL : CA_PAGES_TRANSPARENT);
+    }
+    else if (strcmp(argv[i], "--memory") == 0) show_memory = true;
+    else if (value and strcmp(argv[i], "--counters") == 0){
+      counters_every = atoi(argv[++i]);
+      counters_start();
+    }
+    else if (value and strcmp(argv[i], "--rewind") == 0) rewind_budget_mb = atoi(argv[++i]);
+    else if (value and strcmp(argv[i], "--isa") == 0){
+      isa = ca_isa_from_name(argv[++i]);
+      if (isa < 0){
+        fprintf(stderr, "%s: not scalar, sse, avx2 or avx512\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (value and strcmp(argv[i], "--checkpoint") == 0) checkpoint_dir = argv[++i];
+    else if (value and strcmp(argv[i], "--checkpoint-every") == 0) checkpoint_every = atoi(argv[++i]);
+    else if (value and strcmp(argv[i], "--checkpoint-keep") == 0) checkpoint_keep = atoi(argv[++i]);
+    else if (value and strcmp(argv[i], "--restore") == 0) restore_dir = argv[++i];
+    else if (value and strcmp(argv[i], "--load") == 0) load_path = argv[++i];
+    else if (value and strcmp(argv[i], "--at") == 0){
+      load_at[0] = load_at[1] = load_at[2] = 0;
+      sscanf(argv[++i], "%i,%i,%i", &load_at[0], &load_at[1], &load_at[2]);
+      load_centre = false;
+    }
+    else if (value and strcmp(argv[i], "--lenia") == 0){
+      rule.kind = CA_RULE_LENIA;
+      rule.lenia_radius = atoi(argv[++i]);
+    }
+    else if (value and strcmp(argv[i], "--ltl") == 0){
+      // R2,B14-19,S12-30
+      rule.kind = CA_RULE_LTL;
+      sscanf(argv[++i], "R%i,B%i-%i,S%i-%i", &rule.ltl_radius, &rule.ltl_birth[0], &rule.ltl_birth[1], &rule.ltl_survive[0], &rule.ltl_survive[1]);
+    }
+    else if (value and strcmp(argv[i], "--lenia-peaks") == 0){
+      // ring heights, e.g. 1,0.5,0.25 for three rings
+      char *peak = strtok(argv[++i], ",");
+      for (rule.lenia_rings = 0; peak and rule.lenia_rings < 8; peak = strtok(NULL, ",")){
+        rule.lenia_peaks[rule.lenia_rings++] = atof(peak);
+      }
+      if (rule.lenia_rings == 0) rule.lenia_rings = 1;
+    }
+  }
+
+  if (checkpoint_dir and !checkpoint_start(checkpoint_dir, "ca3d")){
+    return 1;
+  }
+
   glutInit(&argc, argv);
   setup_app();
   setup_menu();
   setup_scene();
-  simulation_setup();
+  lod_setup();
+  simulation_create();
+  if (restore_dir){
+    simulation_restore(restore_dir);
+  }else if (load_path){
+    simulation_load(load_path, load_centre ? NULL : load_at);
+  }else{
+    simulation_setup();
+  }
+  rewind_start(engine);
   glutTimerFunc(0, render_loop, 0);
   glutMainLoop();
    return 0;
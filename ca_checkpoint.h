@@ -0,0 +1,261 @@
+// ----------------------------------------
+// Cellular Automaton Engine - checkpoints
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Periodic snapshots of a running engine, written on a background thread.
+// Taking one does not copy the grid: the engine hands out its current
+// generation (ca_retain_cells) and steps on into a spare buffer, the
+// writer saves it and the buffer goes back once the file is done. The
+// simulation only pays for a pointer swap.
+//
+// Files are DIR/PREFIX_<run>_<iteration>.ckpt: a checkpoint_file header
+// (rule, stats, RNG state) followed by the cells. They are written to a
+// temporary name and renamed, so a crash never leaves half a checkpoint;
+// only the newest checkpoint_keep files are kept. Every start, and every
+// time the iteration goes back (a reseed, a loaded pattern, a rewind),
+// begins a new run, so a run that was thrown away is never newer than
+// the one that replaced it.
+//
+// ----------------------------------------
+
+#ifndef CA_CHECKPOINT_H
+#define CA_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include "ca_engine.h"
+
+static const unsigned CHECKPOINT_MAGIC   = 0x43414b31; // "CAK1"
+static const unsigned CHECKPOINT_VERSION = 1;
+static const int CHECKPOINT_MAX_KEEP     = 256;
+
+struct checkpoint_file {
+  unsigned magic;
+  unsigned version;
+  ca_state state;
+  long count;
+};
+
+static const char *checkpoint_dir     = NULL;
+static const char *checkpoint_prefix  = "ca";
+static int checkpoint_every           = 1000;
+static int checkpoint_keep            = 3;
+static int checkpoint_last            = 0;
+static int checkpoint_run             = 0;
+static ca_state checkpoint_state;
+static int checkpoint_state_run       = 0;
+static const float *checkpoint_retained = NULL;
+static std::atomic<const float*> checkpoint_cells(NULL);
+static std::atomic<bool> checkpoint_written(false);
+static std::atomic<bool> checkpoint_quit(false);
+static pthread_t checkpoint_thread;
+static int stat_checkpoints           = 0;
+static float stat_checkpoint_pause_us = 0.0f;
+
+static double checkpoint_time_us(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+// run and iteration in one number that sorts by run first
+static long long checkpoint_key(int run, int iteration){
+  return (long long)run << 32 | (unsigned)iteration;
+}
+
+// key of DIR/PREFIX_<run>_<iteration>.ckpt, -1 for other files
+static long long checkpoint_parse(const char *name, const char *prefix){
+  int len = strlen(prefix);
+  int run, iteration;
+  char end[8];
+  if (strncmp(name, prefix, len) != 0 or name[len] != '_') return -1;
+  if (sscanf(name + len + 1, "%d_%d%7s", &run, &iteration, end) != 3 or strcmp(end, ".ckpt") != 0) return -1;
+  if (run < 0 or iteration < 0) return -1;
+  return checkpoint_key(run, iteration);
+}
+
+// the keys of all checkpoints in dir, newest first
+static int checkpoint_list(const char *dir, const char *prefix, long long *keys, int max){
+  DIR *d = opendir(dir);
+  int count = 0;
+  if (!d) return 0;
+  for (struct dirent *entry = readdir(d); entry; entry = readdir(d)){
+    long long key = checkpoint_parse(entry->d_name, prefix);
+    if (key < 0) continue;
+    int i;
+    if (count < max) i = count++;
+    else if (key > keys[max - 1]) i = max - 1;
+    else continue;
+    for (; i > 0 and keys[i - 1] < key; i--){
+      keys[i] = keys[i - 1];
+    }
+    keys[i] = key;
+  }
+  closedir(d);
+  return count;
+}
+
+static void checkpoint_path(char *path, int len, const char *dir, const char *prefix, long long key){
+  snprintf(path, len, "%s/%s_%i_%i.ckpt", dir, prefix, (int)(key >> 32), (int)(key & 0xffffffff));
+}
+
+static void checkpoint_write(const ca_state *state, int run, const float *cells){
+  char path[1024], temp[1040];
+  checkpoint_file header;
+  long count = (long)state->size[0] * state->size[1] * state->size[2];
+
+  header.magic = CHECKPOINT_MAGIC;
+  header.version = CHECKPOINT_VERSION;
+  header.state = *state;
+  header.count = count;
+  checkpoint_path(path, sizeof(path), checkpoint_dir, checkpoint_prefix, checkpoint_key(run, state->stats.iteration));
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+  FILE *file = fopen(temp, "wb");
+  if (!file){
+    perror(temp);
+    return;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+    and fwrite(cells, sizeof(float), count, file) == (size_t)count;
+  ok = fflush(file) == 0 and fsync(fileno(file)) == 0 and ok;
+  fclose(file);
+  if (!ok or rename(temp, path) != 0){
+    perror(path);
+    unlink(temp);
+    return;
+  }
+
+  long long keys[CHECKPOINT_MAX_KEEP + 1];
+  int found = checkpoint_list(checkpoint_dir, checkpoint_prefix, keys, CHECKPOINT_MAX_KEEP + 1);
+  for (int i = checkpoint_keep; i < found; i++){
+    checkpoint_path(path, sizeof(path), checkpoint_dir, checkpoint_prefix, keys[i]);
+    unlink(path);
+  }
+}
+
+// polls like the telemetry writer, so handing over a grid is two stores
+// and never a wakeup on the simulation thread
+static void *checkpoint_writer(void *arg){
+  struct timespec nap = {0, 10 * 1000000};
+
+  while (true){
+    const float *cells = checkpoint_cells.load(std::memory_order_acquire);
+    if (cells){
+      checkpoint_write(&checkpoint_state, checkpoint_state_run, cells);
+      checkpoint_cells.store(NULL, std::memory_order_relaxed);
+      checkpoint_written.store(true, std::memory_order_release);
+    }else if (checkpoint_quit.load(std::memory_order_acquire)){
+      break;
+    }else{
+      nanosleep(&nap, NULL);
+    }
+  }
+  return NULL;
+}
+
+static void checkpoint_stop(){
+  if (!checkpoint_dir) return;
+  checkpoint_quit.store(true, std::memory_order_release);
+  pthread_join(checkpoint_thread, NULL);
+  if (checkpoint_written.load(std::memory_order_acquire)) stat_checkpoints++;
+  checkpoint_dir = NULL;
+  fprintf(stderr, "checkpoint: %i written, last pause %.1fus\n", stat_checkpoints, stat_checkpoint_pause_us);
+}
+
+// the files go to dir as prefix_<run>_<iteration>.ckpt, the run after
+// the newest one already there
+static bool checkpoint_start(const char *dir, const char *prefix){
+  DIR *d = opendir(dir);
+  if (!d){
+    perror(dir);
+    return false;
+  }
+  closedir(d);
+  long long newest;
+  checkpoint_dir = dir;
+  checkpoint_prefix = prefix;
+  checkpoint_run = checkpoint_list(dir, prefix, &newest, 1) ? (int)(newest >> 32) + 1 : 0;
+  if (checkpoint_every < 1) checkpoint_every = 1;
+  if (checkpoint_keep < 1) checkpoint_keep = 1;
+  if (checkpoint_keep > CHECKPOINT_MAX_KEEP) checkpoint_keep = CHECKPOINT_MAX_KEEP;
+  pthread_create(&checkpoint_thread, NULL, checkpoint_writer, NULL);
+  atexit(checkpoint_stop);
+  return true;
+}
+
+// loads the newest checkpoint in dir into the engine
+static bool checkpoint_restore(ca_engine *engine, const char *dir, const char *prefix){
+  char path[1024];
+  long long key;
+  checkpoint_file header;
+
+  if (checkpoint_list(dir, prefix, &key, 1) == 0){
+    fprintf(stderr, "%s: no %s checkpoints\n", dir, prefix);
+    return false;
+  }
+  checkpoint_path(path, sizeof(path), dir, prefix, key);
+  FILE *file = fopen(path, "rb");
+  if (!file){
+    perror(path);
+    return false;
+  }
+  float *cells = NULL;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1
+    and header.magic == CHECKPOINT_MAGIC and header.version == CHECKPOINT_VERSION
+    and header.count == (long)header.state.size[0] * header.state.size[1] * header.state.size[2];
+  if (ok){
+    cells = (float*)malloc(header.count * sizeof(float));
+    ok = cells and fread(cells, sizeof(float), header.count, file) == (size_t)header.count
+      and ca_set_state(engine, &header.state, cells);
+  }
+  fclose(file);
+  free(cells);
+  if (!ok){
+    fprintf(stderr, "%s: not a checkpoint of this grid\n", path);
+    return false;
+  }
+  checkpoint_last = header.state.stats.iteration;
+  fprintf(stderr, "restored %s\n", path);
+  return true;
+}
+
+// call after every step, on the stepping thread: gives a written grid
+// back to the engine and starts the next checkpoint when one is due (a
+// due checkpoint waits while the previous one is still being written)
+static void checkpoint_tick(ca_engine *engine){
+  if (!checkpoint_dir) return;
+  if (checkpoint_retained and checkpoint_written.load(std::memory_order_acquire)){
+    checkpoint_written.store(false, std::memory_order_relaxed);
+    ca_release_cells(engine, checkpoint_retained);
+    checkpoint_retained = NULL;
+    stat_checkpoints++;
+  }
+  int iteration = ca_get_stats(engine)->iteration;
+  if (iteration < checkpoint_last){
+    checkpoint_last = iteration;
+    checkpoint_run++;
+  }
+  if (checkpoint_retained or iteration < checkpoint_last + checkpoint_every) return;
+
+  double start = checkpoint_time_us();
+  const float *cells = ca_retain_cells(engine);
+  if (!cells) return;
+  ca_get_state(engine, &checkpoint_state);
+  checkpoint_state_run = checkpoint_run;
+  checkpoint_cells.store(cells, std::memory_order_release);
+  checkpoint_retained = cells;
+  checkpoint_last = iteration;
+  stat_checkpoint_pause_us = checkpoint_time_us() - start;
+}
+
+#endif
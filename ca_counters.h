@@ -0,0 +1,284 @@
+// ----------------------------------------
+// Cellular Automaton Engine - hardware counters
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Cycles, instructions, cache misses and branch misses (perf_event_open)
+// for the phases of a generation: the rule, the swap pass with the stats,
+// and drawing. Every OpenMP thread opens its own counter group, so the
+// rule phase shows each worker on its own; the main thread reads all the
+// groups when the phase changes and the deltas go to the phase that just
+// ended. Every counters_every generations the totals are summed up into
+// stat_counters (and stderr when headless) and start over.
+//
+// Without counters (no PMU in a VM, perf_event_paranoid too high, not
+// Linux) only the time of each phase is shown.
+//
+// ----------------------------------------
+
+#ifndef CA_COUNTERS_H
+#define CA_COUNTERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "ca_engine.h"
+
+static const int COUNTER_IDLE            = -1;
+static const int COUNTER_STEP            = 0;
+static const int COUNTER_SWAP            = 1;
+static const int COUNTER_DRAW            = 2;
+static const int COUNTER_PHASES          = 3;
+static const char *COUNTER_PHASE_NAMES[] = {"STEP", "SWAP", "DRAW"};
+
+// cycles lead the group and instructions come next, both are needed; the
+// misses are shown when the CPU has them
+static const int COUNTER_CYCLES          = 0;
+static const int COUNTER_INSTRUCTIONS    = 1;
+static const int COUNTER_CACHE_MISSES    = 2;
+static const int COUNTER_BRANCH_MISSES   = 3;
+static const int COUNTER_EVENTS          = 4;
+static const int COUNTER_MAX_THREADS     = 64;
+
+static bool counters_on                  = false;
+static bool counters_hardware            = false;
+static bool counters_print               = false;
+static int counters_every                = 100;
+static int counters_threads              = 1;
+// counters of each thread, [t][0] leads the group; -1 when not open
+static int counters_fd[COUNTER_MAX_THREADS][COUNTER_EVENTS];
+// where each event sits in a group read, -1 when it could not be opened
+static int counters_slot[COUNTER_EVENTS];
+static unsigned long long counters_last[COUNTER_MAX_THREADS][COUNTER_EVENTS];
+static unsigned long long counters_total[COUNTER_PHASES][COUNTER_MAX_THREADS][COUNTER_EVENTS];
+static double counters_ms[COUNTER_PHASES];
+static int counters_phase                = COUNTER_IDLE;
+static double counters_since             = 0.0;
+static int counters_generations          = 0;
+static int counters_draws                = 0;
+// phases (all threads) and, with several threads, the rule on each one
+static char stat_counters[2][256];
+
+static double counters_time_ms(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void counters_close_group(int *fds){
+  for (int e = 0; e < COUNTER_EVENTS; e++){
+    if (fds[e] >= 0) close(fds[e]);
+    fds[e] = -1;
+  }
+}
+
+#ifdef __linux__
+static int counters_open_event(unsigned long long config, int group){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// a group on the calling thread into fds; the first call finds out which
+// events the CPU has (counters_slot), later ones open the same. A group
+// that fails is left for counters_close_group(): close() can be a thread
+// cancellation point, and calling it inside an OpenMP region needs the
+// C++ runtime to link.
+static bool counters_open_group(int *fds, bool probe){
+  static const unsigned long long CONFIGS[] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+  int slot = 0;
+
+  for (int e = 0; e < COUNTER_EVENTS; e++){
+    fds[e] = -1;
+  }
+  for (int e = 0; e < COUNTER_EVENTS; e++){
+    if (!probe and counters_slot[e] < 0) continue;
+    fds[e] = counters_open_event(CONFIGS[e], e == 0 ? -1 : fds[0]);
+    if (fds[e] < 0 and (!probe or e <= COUNTER_INSTRUCTIONS)) return false;
+    if (probe) counters_slot[e] = fds[e] < 0 ? -1 : slot;
+    if (fds[e] >= 0) slot++;
+  }
+  return true;
+}
+
+static bool counters_read(int fd, unsigned long long *values){
+  unsigned long long group[1 + COUNTER_EVENTS];
+  if (read(fd, group, sizeof(group)) < (ssize_t)(2 * sizeof(unsigned long long))) return false;
+  for (int e = 0; e < COUNTER_EVENTS; e++){
+    values[e] = counters_slot[e] < 0 ? 0 : group[1 + counters_slot[e]];
+  }
+  return true;
+}
+#else
+static bool counters_open_group(int *fds, bool probe){
+  for (int e = 0; e < COUNTER_EVENTS; e++){
+    fds[e] = -1;
+  }
+  return false;
+}
+
+static bool counters_read(int fd, unsigned long long *values){
+  return false;
+}
+#endif
+
+static void counters_stop(){
+  for (int t = 0; t < counters_threads; t++){
+    counters_close_group(counters_fd[t]);
+  }
+  counters_on = false;
+}
+
+// opens a group on every OpenMP thread; false when there are no counters
+// and only the phases are timed
+static bool counters_start(){
+  counters_on = true;
+  counters_threads = 1;
+#ifdef _OPENMP
+  counters_threads = omp_get_max_threads();
+  if (counters_threads > COUNTER_MAX_THREADS) counters_threads = COUNTER_MAX_THREADS;
+#endif
+  if (counters_every < 1) counters_every = 1;
+  memset(counters_fd, -1, sizeof(counters_fd));
+  counters_hardware = counters_open_group(counters_fd[0], true);
+  if (!counters_hardware) counters_close_group(counters_fd[0]);
+  if (counters_hardware){
+#ifdef _OPENMP
+    bool opened[COUNTER_MAX_THREADS] = {true};
+    // the same team the engine steps on, thread 0 is this one
+    #pragma omp parallel num_threads(counters_threads)
+    {
+      int t = omp_get_thread_num();
+      if (t > 0) opened[t] = counters_open_group(counters_fd[t], false);
+    }
+    for (int t = 1; t < counters_threads; t++){
+      if (!opened[t]) counters_close_group(counters_fd[t]);
+    }
+#endif
+    for (int t = 0; t < counters_threads; t++){
+      if (counters_fd[t][0] >= 0) counters_read(counters_fd[t][0], counters_last[t]);
+    }
+  }
+  if (!counters_hardware){
+    perror("counters: perf_event_open, timing only");
+  }
+  snprintf(stat_counters[0], sizeof(stat_counters[0]), "COUNTERS: [%s]",
+    counters_hardware ? "waiting" : "unavailable, timing only");
+  stat_counters[1][0] = '\0';
+  atexit(counters_stop);
+  return counters_hardware;
+}
+
+// the phase from now on, COUNTER_IDLE for time that belongs to none
+static void counters_switch(int phase){
+  if (!counters_on) return;
+  double now = counters_time_ms();
+  if (counters_phase != COUNTER_IDLE){
+    counters_ms[counters_phase] += now - counters_since;
+  }
+  if (counters_hardware){
+    unsigned long long values[COUNTER_EVENTS];
+    for (int t = 0; t < counters_threads; t++){
+      if (counters_fd[t][0] < 0 or !counters_read(counters_fd[t][0], values)) continue;
+      for (int e = 0; e < COUNTER_EVENTS; e++){
+        if (counters_phase != COUNTER_IDLE){
+          counters_total[counters_phase][t][e] += values[e] - counters_last[t][e];
+        }
+        counters_last[t][e] = values[e];
+      }
+    }
+  }
+  if (phase == COUNTER_DRAW) counters_draws++;
+  counters_phase = phase;
+  counters_since = now;
+}
+
+// ca_set_phase_hook() target
+static void counters_engine_phase(void *user, int phase){
+  counters_switch(phase == CA_PHASE_STEP ? COUNTER_STEP : phase == CA_PHASE_SWAP ? COUNTER_SWAP : COUNTER_IDLE);
+}
+
+// " 1.85 IPC 0.40 CM/KI 1.20 BM/KI" for one set of totals
+static int counters_format(char *text, int len, const unsigned long long *total){
+  double kilo = total[COUNTER_INSTRUCTIONS] / 1000.0;
+  int used = snprintf(text, len, " %.2f IPC", total[COUNTER_CYCLES] ? (double)total[COUNTER_INSTRUCTIONS] / total[COUNTER_CYCLES] : 0.0);
+  if (counters_slot[COUNTER_CACHE_MISSES] >= 0 and used < len){
+    used += snprintf(text + used, len - used, " %.2f CM/KI", kilo > 0 ? total[COUNTER_CACHE_MISSES] / kilo : 0.0);
+  }
+  if (counters_slot[COUNTER_BRANCH_MISSES] >= 0 and used < len){
+    used += snprintf(text + used, len - used, " %.2f BM/KI", kilo > 0 ? total[COUNTER_BRANCH_MISSES] / kilo : 0.0);
+  }
+  return used < len ? used : len - 1;
+}
+
+static void counters_summarize(){
+  char *text = stat_counters[0];
+  int len = sizeof(stat_counters[0]);
+  int used = 0;
+
+  for (int p = 0; p < COUNTER_PHASES and used < len; p++){
+    int count = p == COUNTER_DRAW ? counters_draws : counters_generations;
+    if (count == 0) continue;
+    used += snprintf(text + used, len - used, "%s%s: [%.3fms", used ? " " : "", COUNTER_PHASE_NAMES[p], counters_ms[p] / count);
+    if (counters_hardware and used < len){
+      unsigned long long sum[COUNTER_EVENTS] = {0};
+      for (int t = 0; t < counters_threads; t++){
+      for (int e = 0; e < COUNTER_EVENTS; e++){
+        sum[e] += counters_total[p][t][e];
+      }}
+      used += counters_format(text + used, len - used, sum);
+    }
+    if (used < len) used += snprintf(text + used, len - used, "]");
+  }
+
+  text = stat_counters[1];
+  len = sizeof(stat_counters[1]);
+  used = 0;
+  text[0] = '\0';
+  if (counters_hardware and counters_threads > 1){
+    used = snprintf(text, len, "STEP THREADS:");
+    for (int t = 0; t < counters_threads and used < len; t++){
+      if (counters_fd[t][0] < 0) continue;
+      used += snprintf(text + used, len - used, " [%i:", t);
+      if (used < len) used += counters_format(text + used, len - used, counters_total[COUNTER_STEP][t]);
+      if (used < len) used += snprintf(text + used, len - used, "]");
+    }
+  }
+
+  memset(counters_total, 0, sizeof(counters_total));
+  memset(counters_ms, 0, sizeof(counters_ms));
+  counters_generations = 0;
+  counters_draws = 0;
+}
+
+// call after every step, on the stepping thread
+static void counters_tick(){
+  if (!counters_on) return;
+  if (++counters_generations < counters_every) return;
+  counters_summarize();
+  if (counters_print){
+    fprintf(stderr, "%s\n", stat_counters[0]);
+    if (stat_counters[1][0]) fprintf(stderr, "%s\n", stat_counters[1]);
+  }
+}
+
+#endif
@@ -0,0 +1,1622 @@
+// ----------------------------------------
+// Cellular Automaton Engine - simulation library
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// See ca_engine.h for the API and how to build the library.
+//
+// ----------------------------------------
+
+// LIBS
+// ----------------------------------------------------------------------------
+
+#include "ca_engine.h"
+#include "ca_fft.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// CELL MODELS
+// ----------------------------------------------------------------------------
+// colours and tresholds of the original programs; the 2D colour mode,
+// 2D Conway mode and 3D mode each have their own
+
+struct ca_model {
+  float count_above;      // neighbours are counted above this...
+  bool count_inclusive;   // ...or at it too (3D)
+  float alive_above;      // cells above this follow the survival rule
+  float stat_above;       // cells above this count as alive in stats
+  float start;            // colour of a newborn cell in Conway mode
+  float step;
+  float min;
+  float max;
+  bool conway;
+};
+
+static const ca_model MODEL_2D_COLOUR = {0.3f, false, 0.2f, 0.0f, 0.5f, 0.005f, 0.05f, 1.0f, false};
+static const ca_model MODEL_2D_CONWAY = {0.0f, false, 0.0f, 0.0f, 0.5f, 0.005f, 0.05f, 1.0f, true};
+static const ca_model MODEL_3D        = {0.2f, true,  0.2f, 0.2f, 0.4f, 0.05f,  0.2f,  0.8f, false};
+
+// ENGINE
+// ----------------------------------------------------------------------------
+
+struct ca_engine {
+  int dims;
+  int size[3];
+  long count;
+  ca_rule rule;
+  ca_model model;
+
+  float *cells;
+  float *buffer;
+  // a generation handed out by ca_retain_cells() is not written again
+  // until it is released; the spare buffer takes its place meanwhile
+  float *retained;
+  float *spare;
+  // every grid buffer is one mapping of this size, see GRID MEMORY
+  size_t grid_bytes;
+  bool grid_huge;
+  // instruction set of the life kernels, see CPU DISPATCH
+  int isa;
+  // the life slabs' sums, slab_stride ints for each of the threads there
+  // were at ca_create(), and a line of zeros for the grid edges
+  int threads;
+  int slab_stride;
+  int *slab_sums;
+  float *slab_zero;
+  ca_stats stats;
+  bool detailed;
+  unsigned long long rng;
+
+  ca_change_hook hook;
+  void *hook_user;
+  ca_phase_hook phase_hook;
+  void *phase_user;
+
+  // larger than life: summed-area table with a zero plane in front of
+  // every axis, (size[0]+1) x (size[1]+1) x (size[2]+1)
+  int *ltl_table;
+
+  // lenia: padded field, plans and the kernel spectrum
+  fft_conv lenia_conv;
+  float *lenia_field;
+  int lenia_radius;
+  int lenia_rings;
+  float lenia_peaks[8];
+};
+
+static inline long ca_index(const ca_engine *e, int x, int y, int z){
+  return ((long)x * e->size[1] + y) * e->size[2] + z;
+}
+
+// threads of the parallel loops, and the one running (1 and 0 when
+// built without OpenMP)
+static int ca_threads(){
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static int ca_thread(){
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+static double ca_time_ms(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec * 1e-6;
+}
+
+// xorshift64*, kept in the engine so a run can be repeated from its seed
+static float ca_random_next(unsigned long long *rng){
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return (float)((*rng * 2685821657736338717ULL) >> 40) / (float)(1 << 24);
+}
+
+static float ca_random(ca_engine *e){
+  return ca_random_next(&e->rng);
+}
+
+static float ca_random_colour(ca_engine *e){
+  float r = ca_random(e);
+  if (r < e->model.min){
+    r = 0.0f;
+  }
+  if (r > e->model.max){
+    r = e->model.max;
+  }
+  return r;
+}
+
+static float ca_gain_colour(const ca_model *m, float colour, float step){
+  float new_colour = colour + step;
+  if (new_colour > m->max){
+    new_colour = m->max;
+  }
+  return new_colour;
+}
+
+static float ca_lose_colour(const ca_model *m, float colour, float step){
+  float new_colour = colour - step;
+  if (new_colour < m->min){
+    new_colour = m->min;
+  }
+  return new_colour;
+}
+
+static inline bool ca_counts(const ca_model *m, float cell){
+  return m->count_inclusive ? cell >= m->count_above : cell > m->count_above;
+}
+
+// the outcome for one cell given its neighbour count, shared by the
+// original rules and larger than life
+static inline float ca_apply_rule(const ca_model *m, float cell, bool survive, bool birth){
+  if (cell > m->alive_above){
+    if (!survive){
+      return m->conway ? 0.0f : ca_lose_colour(m, cell, m->step);
+    }
+    return ca_gain_colour(m, cell, m->step);
+  }
+  if (birth){
+    return m->conway ? m->start : ca_gain_colour(m, cell, m->step);
+  }
+  return 0.0f;
+}
+
+// GRID MEMORY
+// ----------------------------------------------------------------------------
+// grid buffers are their own mappings: big ones are 2 MB aligned and
+// asked for huge pages (transparent with madvise, or explicit hugetlb
+// pages with CA_PAGES_EXPLICIT when the system has them reserved). Pages
+// are first touched by the threads that step them, one x slab per
+// thread with the same static schedule as the step loops, so on NUMA
+// machines every slab lives on the node of the thread that works on it.
+
+static const size_t CA_HUGE_PAGE = 2 << 20;
+static int ca_page_policy = CA_PAGES_TRANSPARENT;
+
+static void ca_first_touch(const ca_engine *e, float *cells){
+  long slab = (long)e->size[1] * e->size[2];
+
+  #pragma omp parallel for
+  for (int x = 0; x < e->size[0]; x++){
+    memset(cells + x * slab, 0, slab * sizeof(float));
+  }
+}
+
+static void *ca_map(size_t bytes, int flags){
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+// maps a bit more and trims it to a 2 MB boundary, madvise wants
+// whole huge pages
+static void *ca_map_aligned(size_t bytes){
+  char *p = (char*)ca_map(bytes + CA_HUGE_PAGE, 0);
+  if (!p) return NULL;
+  char *aligned = (char*)(((size_t)p + CA_HUGE_PAGE - 1) & ~(CA_HUGE_PAGE - 1));
+  if (aligned > p) munmap(p, aligned - p);
+  munmap(aligned + bytes, p + CA_HUGE_PAGE - aligned);
+  return aligned;
+}
+
+static float *ca_grid_alloc(ca_engine *e){
+  void *p = NULL;
+
+  if (e->grid_huge){
+    if (ca_page_policy == CA_PAGES_EXPLICIT){
+      p = ca_map(e->grid_bytes, MAP_HUGETLB);
+    }
+    if (!p){
+      p = ca_map_aligned(e->grid_bytes);
+      if (p) madvise(p, e->grid_bytes, MADV_HUGEPAGE);
+    }
+  }else{
+    p = ca_map(e->grid_bytes, 0);
+  }
+  if (p) ca_first_touch(e, (float*)p);
+  return (float*)p;
+}
+
+static void ca_grid_free(ca_engine *e, float *cells){
+  if (cells) munmap(cells, e->grid_bytes);
+}
+
+static void ca_grid_setup(ca_engine *e){
+  size_t bytes = e->count * sizeof(float);
+  size_t page = sysconf(_SC_PAGESIZE);
+  // a huge page per small grid would only waste memory
+  e->grid_huge = ca_page_policy != CA_PAGES_NORMAL and bytes >= CA_HUGE_PAGE;
+  if (e->grid_huge) page = CA_HUGE_PAGE;
+  e->grid_bytes = (bytes + page - 1) / page * page;
+}
+
+// adds the smaps numbers of every mapping that holds one of the buffers
+static void ca_memory_pages(const ca_engine *e, ca_memory *memory){
+  const float *buffers[] = {e->cells, e->buffer, e->retained != e->cells ? e->retained : NULL, e->spare};
+  FILE *smaps = fopen("/proc/self/smaps", "r");
+  char line[256];
+  bool inside = false;
+
+  if (!smaps) return;
+  while (fgets(line, sizeof(line), smaps)){
+    unsigned long start, end, kb;
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2){
+      inside = false;
+      for (int i = 0; i < 4; i++){
+        unsigned long b = (unsigned long)buffers[i];
+        if (b and b < end and b + e->grid_bytes > start) inside = true;
+      }
+    }else if (inside and sscanf(line, "KernelPageSize: %lu kB", &kb) == 1){
+      if ((int)kb > memory->page_kb) memory->page_kb = kb;
+    }else if (inside and sscanf(line, "AnonHugePages: %lu kB", &kb) == 1){
+      memory->huge_bytes += kb * 1024;
+    }else if (inside and sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1){
+      memory->huge_bytes += kb * 1024;
+    }
+  }
+  fclose(smaps);
+}
+
+// asks the kernel where a sample of the pages of the current generation
+// are (move_pages without target nodes only reports)
+static void ca_memory_nodes(const ca_engine *e, ca_memory *memory){
+  static const int SAMPLES = 1024;
+  size_t page = memory->page_kb > 0 ? memory->page_kb * 1024 : sysconf(_SC_PAGESIZE);
+  long pages = (e->grid_bytes + page - 1) / page;
+  int samples = pages < SAMPLES ? pages : SAMPLES;
+  void *addresses[SAMPLES];
+  int status[SAMPLES];
+
+  for (int i = 0; i < samples; i++){
+    addresses[i] = (char*)e->cells + (long)((double)i * pages / samples) * page;
+  }
+  if (syscall(SYS_move_pages, 0, samples, addresses, NULL, status, 0) != 0) return;
+  for (int i = 0; i < samples; i++){
+    if (status[i] < 0 or status[i] >= CA_MAX_NODES) continue;
+    memory->node_share[status[i]] += 1.0f / samples;
+    if (status[i] + 1 > memory->nodes) memory->nodes = status[i] + 1;
+  }
+}
+
+// ORIGINAL RULES
+// ----------------------------------------------------------------------------
+
+static int ca_count_cells(const ca_engine *e, int cx, int cy){
+  int count = 0;
+
+  for (int x = cx-1; x <= cx+1; x++){
+    for (int y = cy-1; y <= cy+1; y++){
+      if (x >= 0 and y >= 0 and x < e->size[0] and y < e->size[1] and !(x == cx and y == cy)){
+        if (ca_counts(&e->model, e->cells[ca_index(e, x, y, 0)])){
+          count++;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+// 3x3x3 block without the centre and the eight corners
+static int ca_count_neigbours(const ca_engine *e, int cx, int cy, int cz){
+  int neigbours = 0;
+
+  for (int x = cx-1; x <= cx+1; x++){
+  for (int y = cy-1; y <= cy+1; y++){
+  for (int z = cz-1; z <= cz+1; z++){
+    if (x < 0 or y < 0 or z < 0 or x >= e->size[0] or y >= e->size[1] or z >= e->size[2]) continue;
+    int off = (x != cx) + (y != cy) + (z != cz);
+    if (off == 0 or off == 3) continue;
+    if (ca_counts(&e->model, e->cells[ca_index(e, x, y, z)])){
+      neigbours++;
+    }
+  }}}
+
+  return neigbours;
+}
+
+static void ca_step_life(ca_engine *e){
+  const ca_model *m = &e->model;
+
+  #pragma omp parallel for
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+  for (int z = 0; z < e->size[2]; z++){
+    long i = ca_index(e, x, y, z);
+    float cell = e->cells[i];
+    if (e->dims == 2){
+      int count = ca_count_cells(e, x, y);
+      e->buffer[i] = ca_apply_rule(m, cell, count >= 2 and count <= 3, count == 3);
+    }else{
+      int neigbours = ca_count_neigbours(e, x, y, z);
+      e->buffer[i] = ca_apply_rule(m, cell, neigbours >= 2 and neigbours <= 6, neigbours == 5);
+    }
+  }}}
+}
+
+// CPU DISPATCH
+// ----------------------------------------------------------------------------
+// the original rules again, a row (2D) or plane (3D) at a time and N
+// cells per instruction with GCC vector types. The same template is
+// compiled for SSE4.2, AVX2 and AVX-512 and picked by what the CPU runs
+// (cpuid); CA_ISA_SCALAR is ca_step_life() above. Every level
+// does the same float operations, so all of them give the same grids.
+
+static const char *CA_ISA_NAMES[] = {"SCALAR", "SSE4.2", "AVX2", "AVX-512"};
+
+// the vector helpers are always inlined, no vector crosses a real call
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+template <int N> struct ca_lanes {
+  typedef float f __attribute__((vector_size(N * 4)));
+  typedef int i __attribute__((vector_size(N * 4)));
+};
+
+template <typename V, typename T> static inline __attribute__((always_inline)) V ca_load(const T *p){
+  V v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+template <typename V, typename T> static inline __attribute__((always_inline)) void ca_store(T *p, const V &v){
+  memcpy(p, &v, sizeof(v));
+}
+
+// occupied cells as 0/1 lanes
+template <int N> static inline __attribute__((always_inline)) typename ca_lanes<N>::i ca_occupied(const ca_model *m, const typename ca_lanes<N>::f &cells){
+  typedef typename ca_lanes<N>::f vf;
+  vf treshold = vf{} + m->count_above;
+  return m->count_inclusive ? -(cells >= treshold) : -(cells > treshold);
+}
+
+static inline int ca_occupied(const ca_model *m, float cell){
+  return ca_counts(m, cell);
+}
+
+// ca_apply_rule() for N cells; survive and birth are count ranges
+template <int N> static inline __attribute__((always_inline)) typename ca_lanes<N>::f ca_apply_rule(const ca_model *m, const typename ca_lanes<N>::f &cell, const typename ca_lanes<N>::i &count, const int *survive, const int *birth){
+  typedef typename ca_lanes<N>::f vf;
+  typedef typename ca_lanes<N>::i vi;
+  vf zero = vf{};
+  vf max = zero + m->max;
+  vf min = zero + m->min;
+
+  vf gain = cell + m->step;
+  gain = gain > max ? max : gain;
+  vf lose = cell - m->step;
+  lose = lose < min ? min : lose;
+  vf dying = m->conway ? zero : lose;
+  vf born = m->conway ? zero + m->start : gain;
+  vi survives = (count >= survive[0]) & (count <= survive[1]);
+  vi births = (count >= birth[0]) & (count <= birth[1]);
+  return cell > m->alive_above ? (survives ? gain : dying) : (births ? born : zero);
+}
+
+// N cells of the three column sums of an x row
+template <int N> static inline __attribute__((always_inline)) void ca_life_row_sums(const ca_model *m, const float *above, const float *row, const float *below, int *sums, int y){
+  typedef typename ca_lanes<N>::f vf;
+  typedef typename ca_lanes<N>::i vi;
+  vi sum = ca_occupied<N>(m, ca_load<vf>(above + y)) + ca_occupied<N>(m, ca_load<vf>(row + y)) + ca_occupied<N>(m, ca_load<vf>(below + y));
+  ca_store(sums + y + 1, sum);
+}
+
+template <int N> static inline __attribute__((always_inline)) void ca_life_row_cells(const ca_model *m, const float *row, float *out, const int *sums, int y){
+  typedef typename ca_lanes<N>::f vf;
+  typedef typename ca_lanes<N>::i vi;
+  static const int SURVIVE[] = {2, 3};
+  static const int BIRTH[] = {3, 3};
+  vf cell = ca_load<vf>(row + y);
+  vi count = ca_load<vi>(sums + y) + ca_load<vi>(sums + y + 1) + ca_load<vi>(sums + y + 2) - ca_occupied<N>(m, cell);
+  ca_store(out + y, ca_apply_rule<N>(m, cell, count, SURVIVE, BIRTH));
+}
+
+// one x row of the 3x3 rule; sums holds h+2 ints. What is left of the row
+// after the N wide steps goes 4 at a time and then one by one.
+template <int N> static inline __attribute__((always_inline)) void ca_life_row(const ca_model *m, const float *above, const float *row, const float *below, float *out, int *sums, int h){
+  int y = 0;
+
+  // three cell columns at a time, padded with an empty column on both ends
+  sums[0] = sums[h + 1] = 0;
+  for (; y + N <= h; y += N) ca_life_row_sums<N>(m, above, row, below, sums, y);
+  for (; y + 4 <= h; y += 4) ca_life_row_sums<4>(m, above, row, below, sums, y);
+  for (; y < h; y++){
+    sums[y + 1] = ca_occupied(m, above[y]) + ca_occupied(m, row[y]) + ca_occupied(m, below[y]);
+  }
+
+  for (y = 0; y + N <= h; y += N) ca_life_row_cells<N>(m, row, out, sums, y);
+  for (; y + 4 <= h; y += 4) ca_life_row_cells<4>(m, row, out, sums, y);
+  for (; y < h; y++){
+    int count = sums[y] + sums[y + 1] + sums[y + 2] - ca_occupied(m, row[y]);
+    out[y] = ca_apply_rule(m, row[y], count >= 2 and count <= 3, count == 3);
+  }
+}
+
+// N cells of the face and line sums of a z line, line[dx][dy] are the
+// 3x3 lines around it
+template <int N> static inline __attribute__((always_inline)) void ca_life_line_sums(const ca_model *m, const float *line[3][3], int *faces, int *lines, int z){
+  typedef typename ca_lanes<N>::f vf;
+  typedef typename ca_lanes<N>::i vi;
+  vi face = ca_occupied<N>(m, ca_load<vf>(line[0][1] + z)) + ca_occupied<N>(m, ca_load<vf>(line[2][1] + z))
+    + ca_occupied<N>(m, ca_load<vf>(line[1][0] + z)) + ca_occupied<N>(m, ca_load<vf>(line[1][2] + z));
+  ca_store(faces + z + 1, face);
+  ca_store(lines + z + 1, face + ca_occupied<N>(m, ca_load<vf>(line[1][1] + z)));
+}
+
+template <int N> static inline __attribute__((always_inline)) void ca_life_line_cells(const ca_model *m, const float *line[3][3], float *out, const int *faces, const int *lines, int z){
+  typedef typename ca_lanes<N>::f vf;
+  typedef typename ca_lanes<N>::i vi;
+  static const int SURVIVE[] = {2, 6};
+  static const int BIRTH[] = {5, 5};
+  vi count = ca_load<vi>(lines + z) + ca_load<vi>(lines + z + 2) + ca_load<vi>(faces + z + 1)
+    + ca_occupied<N>(m, ca_load<vf>(line[0][0] + z)) + ca_occupied<N>(m, ca_load<vf>(line[0][2] + z))
+    + ca_occupied<N>(m, ca_load<vf>(line[2][0] + z)) + ca_occupied<N>(m, ca_load<vf>(line[2][2] + z));
+  ca_store(out + z, ca_apply_rule<N>(m, ca_load<vf>(line[1][1] + z), count, SURVIVE, BIRTH));
+}
+
+// one x plane of the 18 cell rule, a z line at a time. Of the 3x3 lines
+// around the cell, the centre line counts at z-1 and z+1, the four face
+// lines at z-1, z and z+1 and the four corner lines only at z
+template <int N> static inline __attribute__((always_inline)) void ca_life_plane(const ca_engine *e, int x, const float *zero, int *sums){
+  const ca_model *m = &e->model;
+  int w = e->size[0], h = e->size[1], d = e->size[2];
+  int *faces = sums;
+  int *lines = sums + d + 2;
+
+  for (int y = 0; y < h; y++){
+    const float *line[3][3];
+    for (int dx = 0; dx < 3; dx++){
+    for (int dy = 0; dy < 3; dy++){
+      int nx = x + dx - 1, ny = y + dy - 1;
+      line[dx][dy] = (nx < 0 or ny < 0 or nx >= w or ny >= h) ? zero : e->cells + ca_index(e, nx, ny, 0);
+    }}
+    const float *centre = line[1][1];
+    float *out = e->buffer + ca_index(e, x, y, 0);
+    int z = 0;
+
+    faces[0] = faces[d + 1] = lines[0] = lines[d + 1] = 0;
+    for (; z + N <= d; z += N) ca_life_line_sums<N>(m, line, faces, lines, z);
+    for (; z + 4 <= d; z += 4) ca_life_line_sums<4>(m, line, faces, lines, z);
+    for (; z < d; z++){
+      faces[z + 1] = ca_occupied(m, line[0][1][z]) + ca_occupied(m, line[2][1][z]) + ca_occupied(m, line[1][0][z]) + ca_occupied(m, line[1][2][z]);
+      lines[z + 1] = faces[z + 1] + ca_occupied(m, centre[z]);
+    }
+
+    for (z = 0; z + N <= d; z += N) ca_life_line_cells<N>(m, line, out, faces, lines, z);
+    for (; z + 4 <= d; z += 4) ca_life_line_cells<4>(m, line, out, faces, lines, z);
+    for (; z < d; z++){
+      int count = lines[z] + lines[z + 2] + faces[z + 1]
+        + ca_occupied(m, line[0][0][z]) + ca_occupied(m, line[0][2][z]) + ca_occupied(m, line[2][0][z]) + ca_occupied(m, line[2][2][z]);
+      out[z] = ca_apply_rule(m, centre[z], count >= 2 and count <= 6, count == 5);
+    }
+  }
+}
+
+// one x row or plane; sums holds 2 * (line + 2) ints, zero is an empty line
+template <int N> static inline __attribute__((always_inline)) void ca_life_slab(ca_engine *e, int x, const float *zero, int *sums){
+  int w = e->size[0];
+
+  if (e->dims == 2){
+    const float *above = x > 0 ? e->cells + ca_index(e, x - 1, 0, 0) : zero;
+    const float *below = x < w - 1 ? e->cells + ca_index(e, x + 1, 0, 0) : zero;
+    ca_life_row<N>(&e->model, above, e->cells + ca_index(e, x, 0, 0), below, e->buffer + ca_index(e, x, 0, 0), sums, e->size[1]);
+  }else{
+    ca_life_plane<N>(e, x, zero, sums);
+  }
+}
+
+// noexcept keeps the OpenMP body below free of a terminate handler for
+// the indirect call, which would need libstdc++ to link
+typedef void (*ca_slab_kernel)(ca_engine *e, int x, const float *zero, int *sums) noexcept;
+
+// the threads are started here and not in the ISA specific functions,
+// OpenMP bodies do not inherit the target attribute. Same static
+// schedule over x as the first touch of the grid.
+static void ca_step_life_slabs(ca_engine *e, ca_slab_kernel kernel){
+  #pragma omp parallel num_threads(e->threads)
+  {
+    int *sums = e->slab_sums + ca_thread() * e->slab_stride;
+    #pragma omp for
+    for (int x = 0; x < e->size[0]; x++){
+      kernel(e, x, e->slab_zero, sums);
+    }
+  }
+}
+
+#if defined(__x86_64__) or defined(__i386__)
+__attribute__((target("sse4.2"))) static void ca_life_slab_sse(ca_engine *e, int x, const float *zero, int *sums) noexcept{
+  ca_life_slab<4>(e, x, zero, sums);
+}
+
+__attribute__((target("avx2"))) static void ca_life_slab_avx2(ca_engine *e, int x, const float *zero, int *sums) noexcept{
+  ca_life_slab<8>(e, x, zero, sums);
+}
+
+__attribute__((target("avx512f,avx512dq,avx512vl"))) static void ca_life_slab_avx512(ca_engine *e, int x, const float *zero, int *sums) noexcept{
+  ca_life_slab<16>(e, x, zero, sums);
+}
+
+static const ca_slab_kernel CA_LIFE_KERNELS[] = {NULL, ca_life_slab_sse, ca_life_slab_avx2, ca_life_slab_avx512};
+
+static int ca_isa_detect(){
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return CA_ISA_AVX512;
+  if (__builtin_cpu_supports("avx2")) return CA_ISA_AVX2;
+  if (__builtin_cpu_supports("sse4.2")) return CA_ISA_SSE;
+  return CA_ISA_SCALAR;
+}
+#else
+static const ca_slab_kernel CA_LIFE_KERNELS[] = {NULL};
+
+static int ca_isa_detect(){
+  return CA_ISA_SCALAR;
+}
+#endif
+
+// AVX-512 only when asked for: on the parts we ran it lowers the clock
+// enough that AVX2 steps faster, at any grid size
+static int ca_isa_default(){
+  int best = ca_isa_supported();
+  return best > CA_ISA_AVX2 ? CA_ISA_AVX2 : best;
+}
+
+static void ca_step_life_isa(ca_engine *e){
+  if (e->isa == CA_ISA_SCALAR){
+    ca_step_life(e);
+  }else{
+    ca_step_life_slabs(e, CA_LIFE_KERNELS[e->isa]);
+  }
+}
+
+// LARGER THAN LIFE
+// ----------------------------------------------------------------------------
+
+static inline long ca_ltl_index(const ca_engine *e, int x, int y, int z){
+  return ((long)x * (e->size[1] + 1) + y) * (e->size[2] + 1) + z;
+}
+
+// one pass per axis: X adds whole rows (vectorized along the last axis),
+// Y and Z are running sums; every pass is split over threads along an
+// axis it does not sum over
+static void ca_ltl_table(ca_engine *e){
+  int w = e->size[0], h = e->size[1], d = e->size[2];
+  int *table = e->ltl_table;
+
+  #pragma omp parallel for
+  for (int y = 0; y < h; y++){
+  for (int x = 0; x < w; x++){
+    int *row = table + ca_ltl_index(e, x + 1, y + 1, 0);
+    int *previous = table + ca_ltl_index(e, x, y + 1, 0);
+    const float *cells = e->cells + ca_index(e, x, y, 0);
+    if (e->model.count_inclusive){
+      #pragma omp simd
+      for (int z = 0; z < d; z++){
+        row[z + 1] = previous[z + 1] + (cells[z] >= e->model.count_above);
+      }
+    }else{
+      #pragma omp simd
+      for (int z = 0; z < d; z++){
+        row[z + 1] = previous[z + 1] + (cells[z] > e->model.count_above);
+      }
+    }
+  }}
+  #pragma omp parallel for
+  for (int x = 1; x <= w; x++){
+    for (int y = 2; y <= h; y++){
+      int *row = table + ca_ltl_index(e, x, y, 0);
+      int *previous = table + ca_ltl_index(e, x, y - 1, 0);
+      #pragma omp simd
+      for (int z = 1; z <= d; z++){
+        row[z] += previous[z];
+      }
+    }
+    for (int y = 1; y <= h; y++){
+      int *row = table + ca_ltl_index(e, x, y, 0);
+      for (int z = 2; z <= d; z++){
+        row[z] += row[z - 1];
+      }
+    }
+  }
+}
+
+// box count with eight lookups (four of them cancel out in 2D)
+static int ca_ltl_count(const ca_engine *e, int x, int y, int z){
+  int lo[3], hi[3], p[] = {x, y, z};
+  int r = e->rule.ltl_radius;
+  const int *t = e->ltl_table;
+
+  for (int i = 0; i < 3; i++){
+    lo[i] = p[i] - r < 0 ? 0 : p[i] - r;
+    hi[i] = p[i] + r + 1 > e->size[i] ? e->size[i] : p[i] + r + 1;
+  }
+  return t[ca_ltl_index(e, hi[0], hi[1], hi[2])]
+    - t[ca_ltl_index(e, lo[0], hi[1], hi[2])] - t[ca_ltl_index(e, hi[0], lo[1], hi[2])] - t[ca_ltl_index(e, hi[0], hi[1], lo[2])]
+    + t[ca_ltl_index(e, lo[0], lo[1], hi[2])] + t[ca_ltl_index(e, lo[0], hi[1], lo[2])] + t[ca_ltl_index(e, hi[0], lo[1], lo[2])]
+    - t[ca_ltl_index(e, lo[0], lo[1], lo[2])];
+}
+
+static void ca_step_ltl(ca_engine *e){
+  const ca_model *m = &e->model;
+  const ca_rule *rule = &e->rule;
+
+  ca_ltl_table(e);
+
+  #pragma omp parallel for
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+  for (int z = 0; z < e->size[2]; z++){
+    long i = ca_index(e, x, y, z);
+    float cell = e->cells[i];
+    int count = ca_ltl_count(e, x, y, z) - ca_counts(m, cell);
+    bool survive = count >= rule->ltl_survive[0] and count <= rule->ltl_survive[1];
+    bool birth = count >= rule->ltl_birth[0] and count <= rule->ltl_birth[1];
+    e->buffer[i] = ca_apply_rule(m, cell, survive, birth);
+  }}}
+}
+
+// LENIA
+// ----------------------------------------------------------------------------
+
+// ring shaped kernel, one smooth bump per ring
+static float ca_lenia_shell(const ca_rule *rule, float r){
+  float br = r * rule->lenia_rings;
+  int ring = (int)br;
+  float t = br - ring;
+  if (r <= 0.0f or r >= 1.0f or t <= 0.0f) return 0.0f;
+  return rule->lenia_peaks[ring] * expf(4.0f - 1.0f / (t * (1.0f - t)));
+}
+
+// the kernel into lenia_field (padded size p, centre at index 0), returns
+// its sum
+static float ca_lenia_kernel(ca_engine *e, const ca_rule *rule, const int *p){
+  int r = rule->lenia_radius;
+  int rz = e->dims == 3 ? r : 0;
+  float sum = 0.0f;
+  for (int dx = -r; dx <= r; dx++){
+  for (int dy = -r; dy <= r; dy++){
+  for (int dz = -rz; dz <= rz; dz++){
+    float k = ca_lenia_shell(rule, sqrtf(dx*dx + dy*dy + dz*dz) / r);
+    e->lenia_field[(((dx + p[0]) % p[0]) * (long)p[1] + (dy + p[1]) % p[1]) * p[2] + (dz + p[2]) % p[2]] = k;
+    sum += k;
+  }}}
+  return sum;
+}
+
+// pads the grid by the radius so the circular convolution does not wrap,
+// builds the kernel and caches its spectrum; only runs again when the
+// kernel changes; false when out of memory, the field is gone then
+static bool ca_lenia_setup(ca_engine *e){
+  const ca_rule *rule = &e->rule;
+  int r = rule->lenia_radius;
+  int size[3];
+
+  for (int i = 0; i < e->dims; i++){
+    size[i] = e->size[i] + r;
+  }
+  free(e->lenia_field);
+  e->lenia_field = NULL;
+  if (!fft_conv_setup(&e->lenia_conv, e->dims, size)) return false;
+  int p[] = {e->lenia_conv.size[0], e->lenia_conv.size[1], e->dims == 3 ? e->lenia_conv.size[2] : 1};
+
+  e->lenia_field = (float*)calloc(e->lenia_conv.real_count, sizeof(float));
+  if (!e->lenia_field) return false;
+
+  // all rings at height 0 leave nothing to normalize by, one ring of
+  // height 1 is used then
+  ca_rule one_ring = *rule;
+  one_ring.lenia_rings = 1;
+  one_ring.lenia_peaks[0] = 1.0f;
+  float sum = ca_lenia_kernel(e, rule, p);
+  if (sum <= 0.0f) sum = ca_lenia_kernel(e, &one_ring, p);
+  for (long i = 0; i < e->lenia_conv.real_count; i++){
+    e->lenia_field[i] /= sum;
+  }
+  fft_conv_set_kernel(&e->lenia_conv, e->lenia_field);
+
+  e->lenia_radius = r;
+  e->lenia_rings = rule->lenia_rings;
+  memcpy(e->lenia_peaks, rule->lenia_peaks, sizeof(e->lenia_peaks));
+  return true;
+}
+
+static bool ca_lenia_changed(const ca_engine *e){
+  const ca_rule *rule = &e->rule;
+  return !e->lenia_field or e->lenia_radius != rule->lenia_radius or e->lenia_rings != rule->lenia_rings
+    or memcmp(e->lenia_peaks, rule->lenia_peaks, sizeof(e->lenia_peaks)) != 0;
+}
+
+static void ca_step_lenia(ca_engine *e){
+  const ca_rule *rule = &e->rule;
+  const ca_model *m = &e->model;
+
+  int p1 = e->lenia_conv.size[1];
+  int p2 = e->dims == 3 ? e->lenia_conv.size[2] : 1;
+
+  memset(e->lenia_field, 0, e->lenia_conv.real_count * sizeof(float));
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+    memcpy(&e->lenia_field[((long)x * p1 + y) * p2], &e->cells[ca_index(e, x, y, 0)], e->size[2] * sizeof(float));
+  }}
+
+  fft_conv_apply(&e->lenia_conv, e->lenia_field);
+
+  #pragma omp parallel for
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+  for (int z = 0; z < e->size[2]; z++){
+    long i = ca_index(e, x, y, z);
+    float cell = e->cells[i];
+    float d = (e->lenia_field[((long)x * p1 + y) * p2 + z] - rule->lenia_mu) / rule->lenia_sigma;
+    float amount = rule->lenia_dt * (2.0f * expf(-0.5f * d * d) - 1.0f);
+    // growth reuses the gain/lose clamping, cells at the bottom die
+    if (amount >= 0.0f){
+      e->buffer[i] = ca_gain_colour(m, cell, amount);
+    }else if (cell <= m->min){
+      e->buffer[i] = 0.0f;
+    }else{
+      e->buffer[i] = ca_lose_colour(m, cell, -amount);
+    }
+  }}}
+}
+
+// SWAP AND STATS
+// ----------------------------------------------------------------------------
+
+static void ca_stats_clear(ca_stats *stats){
+  int iteration = stats->iteration;
+  memset(stats, 0, sizeof(*stats));
+  stats->iteration = iteration;
+  for (int i = 0; i < 3; i++){
+    stats->box_min[i] = 0x7fffffff;
+    stats->box_max[i] = -1;
+  }
+}
+
+static inline void ca_stats_add(ca_stats *stats, int x, int y, int z, float colour){
+  int bin = (int)(colour * CA_STATS_BINS);
+  if (bin < 0) bin = 0;
+  if (bin >= CA_STATS_BINS) bin = CA_STATS_BINS - 1;
+  stats->histogram[bin]++;
+  int p[] = {x, y, z};
+  for (int i = 0; i < 3; i++){
+    if (p[i] < stats->box_min[i]) stats->box_min[i] = p[i];
+    if (p[i] > stats->box_max[i]) stats->box_max[i] = p[i];
+  }
+}
+
+// ca_retain_cells() only hands out a generation once the spare exists,
+// and a retained generation is moved off at most once (here, by
+// ca_detach() or ca_swap()), so there is always a spare to take and
+// nothing is allocated in the middle of a step
+static float *ca_take_spare(ca_engine *e){
+  float *spare = e->spare;
+  e->spare = NULL;
+  return spare;
+}
+
+// before the current generation is overwritten in place
+static void ca_detach(ca_engine *e){
+  if (e->retained == e->cells){
+    e->cells = ca_take_spare(e);
+  }
+}
+
+// counts the new generation and reports changes, then flips the buffers
+static void ca_swap(ca_engine *e){
+  ca_stats *stats = &e->stats;
+  float stat_above = e->model.stat_above;
+
+  ca_stats_clear(stats);
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+  for (int z = 0; z < e->size[2]; z++){
+    long i = ca_index(e, x, y, z);
+    float old_cell = e->cells[i];
+    float new_cell = e->buffer[i];
+    if (new_cell > stat_above){
+      stats->alive++;
+      if (e->detailed) ca_stats_add(stats, x, y, z, new_cell);
+    }
+    if (old_cell != new_cell){
+      stats->change++;
+      if (e->hook) e->hook(e->hook_user, x, y, z, old_cell, new_cell);
+    }
+  }}}
+
+  float *swap = e->cells;
+  e->cells = e->buffer;
+  e->buffer = swap == e->retained ? ca_take_spare(e) : swap;
+}
+
+// INFINITE WORLD
+// ----------------------------------------------------------------------------
+// the 2D original rule on a plane without edges. The plane is cut into
+// CA_CHUNK_SIZE square chunks kept in a hash map by chunk coordinates;
+// only chunks with something in them exist and get stepped. Each chunk
+// has a one cell halo that is copied in from its eight neighbours before
+// the step, so its rows go through the same kernels as the engine's. A
+// chunk is added when live cells reach the border next to it and goes
+// back to a pool once it is empty; the pool hands it out again later,
+// and frees what is past a quarter of the live chunks (and 64 more) so
+// memory follows the live area down as well as up.
+
+static const int CA_CHUNK_LINE  = CA_CHUNK_SIZE + 2;
+static const int CA_CHUNK_CELLS = CA_CHUNK_LINE * CA_CHUNK_LINE;
+static const int CA_CHUNK_SPARE = 64;
+
+struct ca_chunk {
+  int cx, cy;
+  // padded grids, [x * CA_CHUNK_LINE + y] with the halo at 0 and
+  // CA_CHUNK_LINE - 1; cells is the current generation
+  float *cells;
+  float *buffer;
+  // hash chain (pool list when free) and index in ca_world::chunks
+  ca_chunk *next;
+  int slot;
+  // the generation just stepped, counted by the thread that stepped it
+  int alive;
+  int change;
+  bool empty;
+  int box_min[2];
+  int box_max[2];
+  float grids[2][CA_CHUNK_CELLS];
+};
+
+struct ca_world {
+  ca_rule rule;
+  ca_model model;
+  int isa;
+  ca_stats stats;
+  unsigned long long rng;
+
+  // buckets is a power of two, grown with the chunk count
+  ca_chunk **buckets;
+  int bucket_count;
+  ca_chunk **chunks;
+  int chunk_count;
+  int chunk_capacity;
+
+  ca_chunk *pool;
+  int pooled;
+
+  // the chunk kernels' sums, CA_WORLD_SUMS ints for each of the threads
+  // there were at ca_world_create()
+  int threads;
+  int *sums;
+};
+
+// a row of sums, cache lines apart
+static const int CA_WORLD_SUMS = (CA_CHUNK_LINE + 2 + 15) & ~15;
+
+static inline unsigned ca_chunk_hash(const ca_world *w, int cx, int cy){
+  unsigned h = (unsigned)cx * 0x9E3779B1u ^ (unsigned)cy * 0x85EBCA77u;
+  return (h ^ h >> 15) & (w->bucket_count - 1);
+}
+
+static ca_chunk *ca_chunk_find(const ca_world *w, int cx, int cy){
+  for (ca_chunk *c = w->buckets[ca_chunk_hash(w, cx, cy)]; c; c = c->next){
+    if (c->cx == cx and c->cy == cy) return c;
+  }
+  return NULL;
+}
+
+static void ca_chunk_link(ca_world *w, ca_chunk *c){
+  unsigned h = ca_chunk_hash(w, c->cx, c->cy);
+  c->next = w->buckets[h];
+  w->buckets[h] = c;
+}
+
+static bool ca_world_rehash(ca_world *w, int bucket_count){
+  ca_chunk **buckets = (ca_chunk**)calloc(bucket_count, sizeof(ca_chunk*));
+  if (!buckets) return false;
+  free(w->buckets);
+  w->buckets = buckets;
+  w->bucket_count = bucket_count;
+  for (int i = 0; i < w->chunk_count; i++){
+    ca_chunk_link(w, w->chunks[i]);
+  }
+  return true;
+}
+
+// an empty chunk at cx, cy from the pool; NULL when out of memory
+static ca_chunk *ca_chunk_take(ca_world *w, int cx, int cy){
+  if (!w->pool){
+    ca_chunk *c = (ca_chunk*)malloc(sizeof(ca_chunk));
+    if (!c) return NULL;
+    c->next = NULL;
+    w->pool = c;
+    w->pooled++;
+  }
+  if (w->chunk_count == w->chunk_capacity){
+    int capacity = w->chunk_capacity ? w->chunk_capacity * 2 : 64;
+    ca_chunk **chunks = (ca_chunk**)realloc(w->chunks, capacity * sizeof(ca_chunk*));
+    if (!chunks) return NULL;
+    w->chunks = chunks;
+    w->chunk_capacity = capacity;
+  }
+  if (w->chunk_count >= w->bucket_count and !ca_world_rehash(w, w->bucket_count * 2)) return NULL;
+
+  ca_chunk *c = w->pool;
+  w->pool = c->next;
+  w->pooled--;
+  c->cx = cx;
+  c->cy = cy;
+  c->cells = c->grids[0];
+  c->buffer = c->grids[1];
+  memset(c->cells, 0, CA_CHUNK_CELLS * sizeof(float));
+  c->empty = true;
+  c->slot = w->chunk_count;
+  w->chunks[w->chunk_count++] = c;
+  ca_chunk_link(w, c);
+  return c;
+}
+
+static void ca_chunk_give(ca_world *w, ca_chunk *c){
+  ca_chunk **link = &w->buckets[ca_chunk_hash(w, c->cx, c->cy)];
+  while (*link != c) link = &(*link)->next;
+  *link = c->next;
+
+  ca_chunk *last = w->chunks[--w->chunk_count];
+  w->chunks[c->slot] = last;
+  last->slot = c->slot;
+
+  if (w->pooled >= w->chunk_count / 4 + CA_CHUNK_SPARE){
+    free(c);
+    return;
+  }
+  c->next = w->pool;
+  w->pool = c;
+  w->pooled++;
+}
+
+static inline float *ca_chunk_cell(ca_chunk *c, int x, int y){
+  return c->cells + (x + 1) * CA_CHUNK_LINE + y + 1;
+}
+
+// adds the missing neighbours of every chunk that has counted cells on
+// the border towards them; only those can see births
+static bool ca_world_grow(ca_world *w){
+  const ca_model *m = &w->model;
+  const int last = CA_CHUNK_SIZE - 1;
+  int count = w->chunk_count;
+
+  for (int i = 0; i < count; i++){
+    ca_chunk *c = w->chunks[i];
+    if (c->empty) continue;
+    // west, east, south, north edges and the four corners
+    bool edge[3][3] = {{false}};
+    for (int k = 0; k < CA_CHUNK_SIZE; k++){
+      if (ca_counts(m, *ca_chunk_cell(c, 0, k))) edge[0][1] = true;
+      if (ca_counts(m, *ca_chunk_cell(c, last, k))) edge[2][1] = true;
+      if (ca_counts(m, *ca_chunk_cell(c, k, 0))) edge[1][0] = true;
+      if (ca_counts(m, *ca_chunk_cell(c, k, last))) edge[1][2] = true;
+    }
+    edge[0][0] = ca_counts(m, *ca_chunk_cell(c, 0, 0));
+    edge[0][2] = ca_counts(m, *ca_chunk_cell(c, 0, last));
+    edge[2][0] = ca_counts(m, *ca_chunk_cell(c, last, 0));
+    edge[2][2] = ca_counts(m, *ca_chunk_cell(c, last, last));
+
+    for (int dx = 0; dx < 3; dx++){
+    for (int dy = 0; dy < 3; dy++){
+      if (!edge[dx][dy] or ca_chunk_find(w, c->cx + dx - 1, c->cy + dy - 1)) continue;
+      if (!ca_chunk_take(w, c->cx + dx - 1, c->cy + dy - 1)) return false;
+      // the array may have moved
+      c = w->chunks[i];
+    }}
+  }
+  return true;
+}
+
+// copies the neighbours' border cells into the halo, zeros where there
+// is no neighbour
+static void ca_chunk_halo(const ca_world *w, ca_chunk *c){
+  const int n = CA_CHUNK_SIZE, line = CA_CHUNK_LINE;
+  float *cells = c->cells;
+
+  for (int dx = -1; dx <= 1; dx++){
+  for (int dy = -1; dy <= 1; dy++){
+    if (dx == 0 and dy == 0) continue;
+    const ca_chunk *nb = ca_chunk_find(w, c->cx + dx, c->cy + dy);
+    // the halo row or column on this side, and where it comes from
+    int hx = dx < 0 ? 0 : dx > 0 ? n + 1 : 1;
+    int hy = dy < 0 ? 0 : dy > 0 ? n + 1 : 1;
+    int sx = dx < 0 ? n : 1;
+    int sy = dy < 0 ? n : 1;
+    if (dy == 0){
+      float *to = cells + hx * line + 1;
+      if (nb) memcpy(to, nb->cells + sx * line + 1, n * sizeof(float));
+      else memset(to, 0, n * sizeof(float));
+    }else if (dx == 0){
+      for (int x = 1; x <= n; x++){
+        cells[x * line + hy] = nb ? nb->cells[x * line + sy] : 0.0f;
+      }
+    }else{
+      cells[hx * line + hy] = nb ? nb->cells[sx * line + sy] : 0.0f;
+    }
+  }}
+}
+
+// the scalar level: ca_life_row() without the vectors
+static void ca_life_row_scalar(const ca_model *m, const float *above, const float *row, const float *below, float *out, int *sums, int h){
+  sums[0] = sums[h + 1] = 0;
+  for (int y = 0; y < h; y++){
+    sums[y + 1] = ca_occupied(m, above[y]) + ca_occupied(m, row[y]) + ca_occupied(m, below[y]);
+  }
+  for (int y = 0; y < h; y++){
+    int count = sums[y] + sums[y + 1] + sums[y + 2] - ca_occupied(m, row[y]);
+    out[y] = ca_apply_rule(m, row[y], count >= 2 and count <= 3, count == 3);
+  }
+}
+
+// steps the whole padded line of every row, the halo cells of buffer
+// come out as garbage and are overwritten before the next step
+template <int N> static inline __attribute__((always_inline)) void ca_chunk_rows(const ca_model *m, ca_chunk *c, int *sums){
+  const int line = CA_CHUNK_LINE;
+  for (int x = 1; x <= CA_CHUNK_SIZE; x++){
+    const float *row = c->cells + x * line;
+    if (N == 1){
+      ca_life_row_scalar(m, row - line, row, row + line, c->buffer + x * line, sums, line);
+    }else{
+      ca_life_row<N>(m, row - line, row, row + line, c->buffer + x * line, sums, line);
+    }
+  }
+}
+
+// noexcept for the same reason as ca_slab_kernel
+typedef void (*ca_chunk_kernel)(const ca_model *m, ca_chunk *c, int *sums) noexcept;
+
+static void ca_chunk_rows_scalar(const ca_model *m, ca_chunk *c, int *sums) noexcept{
+  ca_chunk_rows<1>(m, c, sums);
+}
+
+#if defined(__x86_64__) or defined(__i386__)
+__attribute__((target("sse4.2"))) static void ca_chunk_rows_sse(const ca_model *m, ca_chunk *c, int *sums) noexcept{
+  ca_chunk_rows<4>(m, c, sums);
+}
+
+__attribute__((target("avx2"))) static void ca_chunk_rows_avx2(const ca_model *m, ca_chunk *c, int *sums) noexcept{
+  ca_chunk_rows<8>(m, c, sums);
+}
+
+__attribute__((target("avx512f,avx512dq,avx512vl"))) static void ca_chunk_rows_avx512(const ca_model *m, ca_chunk *c, int *sums) noexcept{
+  ca_chunk_rows<16>(m, c, sums);
+}
+
+static const ca_chunk_kernel CA_CHUNK_KERNELS[] = {ca_chunk_rows_scalar, ca_chunk_rows_sse, ca_chunk_rows_avx2, ca_chunk_rows_avx512};
+#else
+static const ca_chunk_kernel CA_CHUNK_KERNELS[] = {ca_chunk_rows_scalar};
+#endif
+
+// stats of the generation in buffer against the one in cells
+static void ca_chunk_count(const ca_model *m, ca_chunk *c){
+  c->alive = c->change = 0;
+  c->empty = true;
+  c->box_min[0] = c->box_min[1] = CA_CHUNK_SIZE;
+  c->box_max[0] = c->box_max[1] = -1;
+  for (int x = 1; x <= CA_CHUNK_SIZE; x++){
+  for (int y = 1; y <= CA_CHUNK_SIZE; y++){
+    int i = x * CA_CHUNK_LINE + y;
+    float new_cell = c->buffer[i];
+    if (new_cell != 0.0f) c->empty = false;
+    if (new_cell != c->cells[i]) c->change++;
+    if (new_cell > m->stat_above){
+      c->alive++;
+      if (x - 1 < c->box_min[0]) c->box_min[0] = x - 1;
+      if (x - 1 > c->box_max[0]) c->box_max[0] = x - 1;
+      if (y - 1 < c->box_min[1]) c->box_min[1] = y - 1;
+      if (y - 1 > c->box_max[1]) c->box_max[1] = y - 1;
+    }
+  }}
+}
+
+// halo, rule and counting are one task per chunk: a chunk only writes
+// its own halo and buffer, and only reads its neighbours' inner cells
+static void ca_world_generation(ca_world *w){
+  const ca_model *m = &w->model;
+  ca_chunk_kernel kernel = CA_CHUNK_KERNELS[w->isa];
+
+  #pragma omp parallel num_threads(w->threads)
+  {
+    int *sums = w->sums + ca_thread() * CA_WORLD_SUMS;
+    #pragma omp for schedule(dynamic, 4)
+    for (int i = 0; i < w->chunk_count; i++){
+      ca_chunk *c = w->chunks[i];
+      ca_chunk_halo(w, c);
+      kernel(m, c, sums);
+      ca_chunk_count(m, c);
+    }
+  }
+}
+
+// sums up the chunks, flips their buffers and pools the empty ones
+static void ca_world_swap(ca_world *w){
+  ca_stats *stats = &w->stats;
+
+  ca_stats_clear(stats);
+  for (int i = w->chunk_count - 1; i >= 0; i--){
+    ca_chunk *c = w->chunks[i];
+    stats->alive += c->alive;
+    stats->change += c->change;
+    if (c->alive > 0){
+      int origin[] = {c->cx * CA_CHUNK_SIZE, c->cy * CA_CHUNK_SIZE};
+      for (int a = 0; a < 2; a++){
+        if (origin[a] + c->box_min[a] < stats->box_min[a]) stats->box_min[a] = origin[a] + c->box_min[a];
+        if (origin[a] + c->box_max[a] > stats->box_max[a]) stats->box_max[a] = origin[a] + c->box_max[a];
+      }
+      stats->box_min[2] = stats->box_max[2] = 0;
+    }
+    float *swap = c->cells;
+    c->cells = c->buffer;
+    c->buffer = swap;
+    if (c->empty) ca_chunk_give(w, c);
+  }
+}
+
+// API
+// ----------------------------------------------------------------------------
+
+extern "C" {
+
+ca_rule ca_rule_default(int dims){
+  ca_rule rule;
+  memset(&rule, 0, sizeof(rule));
+  rule.kind = CA_RULE_LIFE;
+  rule.conway = 0;
+  if (dims == 3){
+    // radius 2 box, 124 neighbours
+    rule.ltl_radius = 2;
+    rule.ltl_birth[0] = 14; rule.ltl_birth[1] = 19;
+    rule.ltl_survive[0] = 12; rule.ltl_survive[1] = 30;
+    rule.lenia_radius = 10;
+  }else{
+    // Bosco's rule
+    rule.ltl_radius = 5;
+    rule.ltl_birth[0] = 34; rule.ltl_birth[1] = 45;
+    rule.ltl_survive[0] = 33; rule.ltl_survive[1] = 57;
+    rule.lenia_radius = 13;
+  }
+  rule.lenia_rings = 1;
+  rule.lenia_peaks[0] = 1.0f;
+  rule.lenia_mu = 0.15f;
+  rule.lenia_sigma = 0.015f;
+  rule.lenia_dt = 0.1f;
+  return rule;
+}
+
+int ca_set_rule(ca_engine *e, const ca_rule *rule){
+  ca_rule previous = e->rule;
+  // the summed area table of Larger than Life, its zero borders stay put
+  if (rule->kind == CA_RULE_LTL and !e->ltl_table){
+    e->ltl_table = (int*)calloc((size_t)(e->size[0] + 1) * (e->size[1] + 1) * (e->size[2] + 1), sizeof(int));
+    if (!e->ltl_table) return 0;
+  }
+  e->rule = *rule;
+  if (e->rule.ltl_radius < 1) e->rule.ltl_radius = 1;
+  if (e->rule.ltl_radius > CA_MAX_LTL_RADIUS) e->rule.ltl_radius = CA_MAX_LTL_RADIUS;
+  // at radius 1 every neighbour sits on the kernel's edge, where it is 0
+  if (e->rule.lenia_radius < 2) e->rule.lenia_radius = 2;
+  if (e->rule.lenia_radius > CA_MAX_LENIA_RADIUS) e->rule.lenia_radius = CA_MAX_LENIA_RADIUS;
+  if (e->rule.lenia_rings < 1) e->rule.lenia_rings = 1;
+  if (e->rule.lenia_rings > 8) e->rule.lenia_rings = 8;
+  int ok = 1;
+  // the Lenia kernel is set up again when its shape changes; without
+  // memory for it the previous rule stays, or plain life when that was
+  // Lenia too (its kernel is gone)
+  if (e->rule.kind == CA_RULE_LENIA and ca_lenia_changed(e) and !ca_lenia_setup(e)){
+    e->rule = previous.kind == CA_RULE_LENIA ? ca_rule_default(e->dims) : previous;
+    ok = 0;
+  }
+  if (e->dims == 3){
+    e->model = MODEL_3D;
+  }else{
+    e->model = e->rule.conway ? MODEL_2D_CONWAY : MODEL_2D_COLOUR;
+  }
+  return ok;
+}
+
+const ca_rule *ca_get_rule(const ca_engine *e){
+  return &e->rule;
+}
+
+ca_engine *ca_create(int dims, const int *size, const ca_rule *rule){
+  if (dims != 2 and dims != 3) return NULL;
+
+  ca_engine *e = (ca_engine*)calloc(1, sizeof(ca_engine));
+  if (!e) return NULL;
+  e->dims = dims;
+  e->size[2] = 1;
+  for (int i = 0; i < dims; i++){
+    e->size[i] = size[i] < 1 ? 1 : size[i];
+  }
+  e->count = (long)e->size[0] * e->size[1] * e->size[2];
+  ca_grid_setup(e);
+  e->cells = ca_grid_alloc(e);
+  e->buffer = ca_grid_alloc(e);
+  // a row of sums both sides of the line, cache lines apart
+  int line = dims == 2 ? e->size[1] : e->size[2];
+  e->threads = ca_threads();
+  e->slab_stride = (2 * (line + 2) + 15) & ~15;
+  e->slab_sums = (int*)malloc((size_t)e->threads * e->slab_stride * sizeof(int));
+  e->slab_zero = (float*)calloc(line, sizeof(float));
+  if (!e->cells or !e->buffer or !e->slab_sums or !e->slab_zero){
+    ca_destroy(e);
+    return NULL;
+  }
+  e->rng = 0x9E3779B97F4A7C15ULL;
+  e->isa = ca_isa_default();
+
+  ca_rule defaults = ca_rule_default(dims);
+  if (!ca_set_rule(e, rule ? rule : &defaults)){
+    ca_destroy(e);
+    return NULL;
+  }
+  ca_stats_clear(&e->stats);
+  return e;
+}
+
+void ca_destroy(ca_engine *e){
+  if (!e) return;
+  fft_conv_free(&e->lenia_conv);
+  free(e->lenia_field);
+  free(e->ltl_table);
+  free(e->slab_sums);
+  free(e->slab_zero);
+  if (e->retained != e->cells) ca_grid_free(e, e->retained);
+  ca_grid_free(e, e->spare);
+  ca_grid_free(e, e->cells);
+  ca_grid_free(e, e->buffer);
+  free(e);
+}
+
+void ca_set_seed(ca_engine *e, unsigned long long seed){
+  e->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+void ca_clear(ca_engine *e){
+  ca_detach(e);
+  memset(e->cells, 0, e->count * sizeof(float));
+  ca_stats_clear(&e->stats);
+  e->stats.iteration = 0;
+}
+
+void ca_set_cells(ca_engine *e, const float *cells){
+  ca_detach(e);
+  memcpy(e->cells, cells, e->count * sizeof(float));
+  ca_stats_clear(&e->stats);
+  e->stats.iteration = 0;
+}
+
+void ca_fill_random(ca_engine *e){
+  const ca_model *m = &e->model;
+  int kind = e->rule.kind;
+
+  ca_detach(e);
+
+  for (int x = 0; x < e->size[0]; x++){
+  for (int y = 0; y < e->size[1]; y++){
+  for (int z = 0; z < e->size[2]; z++){
+    float *cell = &e->cells[ca_index(e, x, y, z)];
+    bool inside = x > e->size[0]*0.2 and x < e->size[0]*0.8 and y > e->size[1]*0.2 and y < e->size[1]*0.8;
+    if (e->dims == 3) inside = inside and z > e->size[2]*0.2 and z < e->size[2]*0.8;
+
+    if (e->dims == 3){
+      float density = kind == CA_RULE_LIFE ? 0.85f : 0.5f;
+      *cell = (inside and ca_random(e) > density) ? ca_random_colour(e) : 0.0f;
+    }else if (kind == CA_RULE_LENIA){
+      // soft noise in the middle of the board
+      *cell = (inside and ca_random(e) > 0.5f) ? ca_random(e) : 0.0f;
+    }else{
+      float density = kind == CA_RULE_LTL ? 0.5f : 0.85f;
+      *cell = ca_random(e) >= density ? m->start : 0.0f;
+    }
+  }}}
+
+  ca_stats_clear(&e->stats);
+  e->stats.iteration = 0;
+}
+
+static inline void ca_phase(ca_engine *e, int phase){
+  if (e->phase_hook) e->phase_hook(e->phase_user, phase);
+}
+
+void ca_step(ca_engine *e, int generations){
+  for (int g = 0; g < generations; g++){
+    double start = ca_time_ms();
+    ca_phase(e, CA_PHASE_STEP);
+    if (e->rule.kind == CA_RULE_LENIA){
+      ca_step_lenia(e);
+    }else if (e->rule.kind == CA_RULE_LTL){
+      ca_step_ltl(e);
+    }else{
+      ca_step_life_isa(e);
+    }
+    if (e->stats.alive > 0){
+      e->stats.iteration++;
+    }
+    ca_phase(e, CA_PHASE_SWAP);
+    ca_swap(e);
+    ca_phase(e, CA_PHASE_DONE);
+    e->stats.step_ms = ca_time_ms() - start;
+  }
+}
+
+const float *ca_cells(const ca_engine *e){
+  return e->cells;
+}
+
+const float *ca_retain_cells(ca_engine *e){
+  if (e->retained) return NULL;
+  // the buffer ca_take_spare() will need, or nothing is retained
+  if (!e->spare){
+    e->spare = ca_grid_alloc(e);
+    if (!e->spare) return NULL;
+  }
+  e->retained = e->cells;
+  return e->retained;
+}
+
+void ca_release_cells(ca_engine *e, const float *cells){
+  if (!e->retained or cells != e->retained) return;
+  if (e->retained != e->cells){
+    ca_grid_free(e, e->spare);
+    e->spare = e->retained;
+  }
+  e->retained = NULL;
+}
+
+void ca_get_state(const ca_engine *e, ca_state *state){
+  state->dims = e->dims;
+  memcpy(state->size, e->size, sizeof(state->size));
+  state->rule = e->rule;
+  state->stats = e->stats;
+  state->rng = e->rng;
+}
+
+int ca_set_state(ca_engine *e, const ca_state *state, const float *cells){
+  if (state->dims != e->dims or memcmp(state->size, e->size, sizeof(e->size)) != 0) return 0;
+  if (!ca_set_rule(e, &state->rule)) return 0;
+  ca_set_cells(e, cells);
+  e->stats = state->stats;
+  e->rng = state->rng;
+  return 1;
+}
+
+int ca_isa_supported(){
+  static int isa = -1;
+  if (isa < 0) isa = ca_isa_detect();
+  return isa;
+}
+
+int ca_set_isa(ca_engine *e, int isa){
+  int best = ca_isa_supported();
+  e->isa = isa < 0 ? ca_isa_default() : isa > best ? best : isa;
+  return e->isa;
+}
+
+int ca_get_isa(const ca_engine *e){
+  return e->isa;
+}
+
+const char *ca_isa_name(int isa){
+  return isa >= 0 and isa <= CA_ISA_AVX512 ? CA_ISA_NAMES[isa] : "?";
+}
+
+int ca_isa_from_name(const char *name){
+  static const char *SHORT[] = {"scalar", "sse", "avx2", "avx512"};
+  for (int isa = CA_ISA_SCALAR; isa <= CA_ISA_AVX512; isa++){
+    if (strcasecmp(name, SHORT[isa]) == 0 or strcasecmp(name, CA_ISA_NAMES[isa]) == 0) return isa;
+  }
+  return -1;
+}
+
+void ca_set_page_policy(int policy){
+  ca_page_policy = policy;
+}
+
+void ca_get_memory(const ca_engine *e, ca_memory *memory){
+  memset(memory, 0, sizeof(*memory));
+  memory->buffers = 2 + (e->spare != NULL) + (e->retained and e->retained != e->cells);
+  memory->bytes = (long)memory->buffers * e->grid_bytes;
+  ca_memory_pages(e, memory);
+  ca_memory_nodes(e, memory);
+}
+
+void ca_memory_report(const ca_engine *e, char *text, int len){
+  ca_memory memory;
+  ca_get_memory(e, &memory);
+  int used = snprintf(text, len, "MEMORY: [%i x %.2f MB] PAGE: [%i kB] HUGE: [%.1f MB]",
+    memory.buffers, e->grid_bytes / 1048576.0, memory.page_kb, memory.huge_bytes / 1048576.0);
+  for (int i = 0; i < memory.nodes and used < len; i++){
+    used += snprintf(text + used, len - used, " NODE %i: [%.0f%%]", i, memory.node_share[i] * 100.0f);
+  }
+}
+
+const int *ca_size(const ca_engine *e){
+  return e->size;
+}
+
+int ca_dims(const ca_engine *e){
+  return e->dims;
+}
+
+const ca_stats *ca_get_stats(const ca_engine *e){
+  return &e->stats;
+}
+
+void ca_set_detailed_stats(ca_engine *e, int detailed){
+  e->detailed = detailed;
+}
+
+void ca_set_change_hook(ca_engine *e, ca_change_hook hook, void *user){
+  e->hook = hook;
+  e->hook_user = user;
+}
+
+void ca_set_phase_hook(ca_engine *e, ca_phase_hook hook, void *user){
+  e->phase_hook = hook;
+  e->phase_user = user;
+}
+
+
+ca_world *ca_world_create(const ca_rule *rule){
+  ca_world *w = (ca_world*)calloc(1, sizeof(ca_world));
+  if (!w) return NULL;
+  w->threads = ca_threads();
+  w->sums = (int*)malloc((size_t)w->threads * CA_WORLD_SUMS * sizeof(int));
+  if (!w->sums or !ca_world_rehash(w, 64)){
+    free(w->sums);
+    free(w);
+    return NULL;
+  }
+  w->rng = 0x9E3779B97F4A7C15ULL;
+  w->isa = ca_isa_default();
+  ca_rule defaults = ca_rule_default(2);
+  ca_world_set_rule(w, rule ? rule : &defaults);
+  ca_stats_clear(&w->stats);
+  return w;
+}
+
+void ca_world_destroy(ca_world *w){
+  if (!w) return;
+  for (int i = 0; i < w->chunk_count; i++){
+    free(w->chunks[i]);
+  }
+  while (w->pool){
+    ca_chunk *c = w->pool;
+    w->pool = c->next;
+    free(c);
+  }
+  free(w->chunks);
+  free(w->buckets);
+  free(w->sums);
+  free(w);
+}
+
+void ca_world_set_rule(ca_world *w, const ca_rule *rule){
+  w->rule = *rule;
+  w->model = w->rule.conway ? MODEL_2D_CONWAY : MODEL_2D_COLOUR;
+}
+
+const ca_rule *ca_world_get_rule(const ca_world *w){
+  return &w->rule;
+}
+
+void ca_world_set_seed(ca_world *w, unsigned long long seed){
+  w->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+void ca_world_clear(ca_world *w){
+  while (w->chunk_count > 0){
+    ca_chunk_give(w, w->chunks[w->chunk_count - 1]);
+  }
+  ca_stats_clear(&w->stats);
+  w->stats.iteration = 0;
+}
+
+int ca_world_set_cell(ca_world *w, int x, int y, float cell){
+  // floor division, chunks left of and below zero included
+  int cx = x >> CA_CHUNK_BITS, cy = y >> CA_CHUNK_BITS;
+  ca_chunk *c = ca_chunk_find(w, cx, cy);
+  if (!c){
+    if (cell == 0.0f) return 1;
+    c = ca_chunk_take(w, cx, cy);
+    if (!c) return 0;
+  }
+  *ca_chunk_cell(c, x & (CA_CHUNK_SIZE - 1), y & (CA_CHUNK_SIZE - 1)) = cell;
+  if (cell != 0.0f) c->empty = false;
+  return 1;
+}
+
+float ca_world_get_cell(const ca_world *w, int x, int y){
+  ca_chunk *c = ca_chunk_find(w, x >> CA_CHUNK_BITS, y >> CA_CHUNK_BITS);
+  return c ? *ca_chunk_cell(c, x & (CA_CHUNK_SIZE - 1), y & (CA_CHUNK_SIZE - 1)) : 0.0f;
+}
+
+int ca_world_fill_random(ca_world *w, int x, int y, int width, int height){
+  for (int i = 0; i < width; i++){
+  for (int j = 0; j < height; j++){
+    float cell = ca_random_next(&w->rng) >= 0.85f ? w->model.start : 0.0f;
+    if (!ca_world_set_cell(w, x + i, y + j, cell)) return 0;
+  }}
+  ca_stats_clear(&w->stats);
+  w->stats.iteration = 0;
+  return 1;
+}
+
+int ca_world_step(ca_world *w, int generations){
+  for (int g = 0; g < generations; g++){
+    double start = ca_time_ms();
+    if (!ca_world_grow(w)) return 0;
+    ca_world_generation(w);
+    if (w->stats.alive > 0){
+      w->stats.iteration++;
+    }
+    ca_world_swap(w);
+    w->stats.step_ms = ca_time_ms() - start;
+  }
+  return 1;
+}
+
+void ca_world_read(const ca_world *w, int x, int y, int width, int height, float *cells){
+  memset(cells, 0, (long)width * height * sizeof(float));
+  if (width < 1 or height < 1) return;
+
+  for (int cx = x >> CA_CHUNK_BITS; cx <= (x + width - 1) >> CA_CHUNK_BITS; cx++){
+  for (int cy = y >> CA_CHUNK_BITS; cy <= (y + height - 1) >> CA_CHUNK_BITS; cy++){
+    ca_chunk *c = ca_chunk_find(w, cx, cy);
+    if (!c) continue;
+    // the part of the chunk inside the window, in world cells
+    int x0 = cx * CA_CHUNK_SIZE, y0 = cy * CA_CHUNK_SIZE;
+    int from[] = {x0 > x ? x0 : x, y0 > y ? y0 : y};
+    int to[] = {x0 + CA_CHUNK_SIZE < x + width ? x0 + CA_CHUNK_SIZE : x + width,
+                y0 + CA_CHUNK_SIZE < y + height ? y0 + CA_CHUNK_SIZE : y + height};
+    for (int i = from[0]; i < to[0]; i++){
+      memcpy(cells + (long)(i - x) * height + (from[1] - y), ca_chunk_cell(c, i - x0, from[1] - y0), (to[1] - from[1]) * sizeof(float));
+    }
+  }}
+}
+
+const ca_stats *ca_world_get_stats(const ca_world *w){
+  return &w->stats;
+}
+
+int ca_world_set_isa(ca_world *w, int isa){
+  int best = ca_isa_supported();
+  w->isa = isa < 0 ? ca_isa_default() : isa > best ? best : isa;
+  return w->isa;
+}
+
+int ca_world_get_isa(const ca_world *w){
+  return w->isa;
+}
+
+int ca_world_chunks(const ca_world *w, int *pooled){
+  if (pooled) *pooled = w->pooled;
+  return w->chunk_count;
+}
+
+void ca_world_report(const ca_world *w, char *text, int len){
+  snprintf(text, len, "CHUNKS: [%i + %i pooled] MEMORY: [%.2f MB]",
+    w->chunk_count, w->pooled, (double)(w->chunk_count + w->pooled) * sizeof(ca_chunk) / 1048576.0);
+}
+
+}
@@ -0,0 +1,237 @@
+// ----------------------------------------
+// Cellular Automaton Engine - simulation library
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Stepping, seeding and stats for the 2D and 3D automata without any
+// OpenGL. ca2d and ca3d are front-ends over it; other programs can link
+// it and read the grid straight from the engine without copying.
+//
+// Library:
+// g++ -O2 -fopenmp -c ca_engine.cpp -o ca_engine.o
+// ar rcs libcaengine.a ca_engine.o
+//
+// Usage:
+// int size[] = {84, 48};
+// ca_rule rule = ca_rule_default(2);
+// ca_engine *engine = ca_create(2, size, &rule);
+// ca_fill_random(engine);
+// ca_step(engine, 100);
+// const float *cells = ca_cells(engine);   // cells[x * 48 + y]
+// printf("%i\n", ca_get_stats(engine)->alive);
+// ca_destroy(engine);
+//
+// The 2D rule on a plane without edges, stored as chunks (ca_world):
+// ca_world *world = ca_world_create(&rule);
+// ca_world_fill_random(world, -42, -24, 84, 48);
+// ca_world_step(world, 100);
+// ca_world_read(world, -42, -24, 84, 48, cells);   // cells[x * 48 + y]
+// ca_world_destroy(world);
+//
+// ----------------------------------------
+
+#ifndef CA_ENGINE_H
+#define CA_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CA_RULE_LIFE   the original rule: 2D Conway or colour mode, 3D 18 cell
+// CA_RULE_LTL    larger than life, box of radius ltl_radius
+// CA_RULE_LENIA  continuous, ring kernel of radius lenia_radius
+#define CA_RULE_LIFE   0
+#define CA_RULE_LTL    1
+#define CA_RULE_LENIA  2
+
+#define CA_MAX_LTL_RADIUS   10
+#define CA_MAX_LENIA_RADIUS 64
+#define CA_STATS_BINS       16
+#define CA_MAX_NODES        8
+
+// how grid buffers are backed, see ca_set_page_policy()
+#define CA_PAGES_NORMAL       0
+#define CA_PAGES_TRANSPARENT  1
+#define CA_PAGES_EXPLICIT     2
+
+typedef struct ca_rule {
+  int kind;
+  // 2D only: on/off cells instead of gaining/losing colour
+  int conway;
+  int ltl_radius;
+  int ltl_birth[2];
+  int ltl_survive[2];
+  int lenia_radius;
+  int lenia_rings;
+  float lenia_peaks[8];
+  float lenia_mu;
+  float lenia_sigma;
+  float lenia_dt;
+} ca_rule;
+
+typedef struct ca_stats {
+  int iteration;
+  int alive;
+  int change;
+  float step_ms;
+  // bounding box of live cells, min > max when nothing is alive; the
+  // box and the histogram are only filled with ca_set_detailed_stats()
+  int box_min[3];
+  int box_max[3];
+  // alive cells by colour, bin = colour * CA_STATS_BINS
+  int histogram[CA_STATS_BINS];
+} ca_stats;
+
+// everything besides the cells that is needed to continue a run exactly
+typedef struct ca_state {
+  int dims;
+  int size[3];
+  ca_rule rule;
+  ca_stats stats;
+  unsigned long long rng;
+} ca_state;
+
+// instruction sets of the original (CA_RULE_LIFE) kernels. Engines start
+// with the best one the CPU supports up to AVX2; ca_set_isa() picks
+// another, AVX-512 included
+#define CA_ISA_SCALAR  0
+#define CA_ISA_SSE     1
+#define CA_ISA_AVX2    2
+#define CA_ISA_AVX512  3
+
+// what the kernel actually gave the grid buffers
+typedef struct ca_memory {
+  int buffers;
+  long bytes;
+  // largest page size seen in the buffer mappings, and how much of them
+  // sits in huge pages (transparent or explicit)
+  int page_kb;
+  long huge_bytes;
+  // share of the current generation's pages on each NUMA node
+  int nodes;
+  float node_share[CA_MAX_NODES];
+} ca_memory;
+
+typedef struct ca_engine ca_engine;
+
+// called from the swap pass for every cell that changed
+typedef void (*ca_change_hook)(void *user, int x, int y, int z, float old_cell, float new_cell);
+
+// phases of a generation: the rule (on all threads), the swap pass with
+// the stats and change hook (on the calling thread), and done
+#define CA_PHASE_STEP  0
+#define CA_PHASE_SWAP  1
+#define CA_PHASE_DONE  2
+
+// called from ca_step() on the calling thread as each phase begins
+typedef void (*ca_phase_hook)(void *user, int phase);
+
+ca_rule ca_rule_default(int dims);
+
+// for engines created afterwards; grids of 2 MB and more get huge pages
+// (CA_PAGES_TRANSPARENT by default), explicit ones fall back to
+// transparent when none are reserved
+void ca_set_page_policy(int policy);
+
+// dims is 2 or 3, size holds dims values; NULL when out of memory
+ca_engine *ca_create(int dims, const int *size, const ca_rule *rule);
+void ca_destroy(ca_engine *engine);
+
+// 0 when out of memory for the rule's tables (Larger than Life, Lenia);
+// the previous rule stays then, or plain life when that was Lenia too
+int ca_set_rule(ca_engine *engine, const ca_rule *rule);
+const ca_rule *ca_get_rule(const ca_engine *engine);
+
+// random grid suited to the current rule, resets the iteration count
+void ca_fill_random(ca_engine *engine);
+void ca_clear(ca_engine *engine);
+// copies a whole grid (same layout as ca_cells) into the current generation
+void ca_set_cells(ca_engine *engine, const float *cells);
+void ca_set_seed(ca_engine *engine, unsigned long long seed);
+
+void ca_step(ca_engine *engine, int generations);
+
+int ca_isa_supported(void);
+// returns the level actually used, never above ca_isa_supported();
+// a negative isa goes back to the default
+int ca_set_isa(ca_engine *engine, int isa);
+int ca_get_isa(const ca_engine *engine);
+const char *ca_isa_name(int isa);
+// scalar, sse, avx2 or avx512 (or the ca_isa_name() spelling), -1 if unknown
+int ca_isa_from_name(const char *name);
+
+// the current generation, x major and the last axis contiguous:
+// cells[(x * size[1] + y) * size[2] + z] (size[2] is 1 in 2D). The
+// pointer changes after every step, fetch it again after ca_step().
+const float *ca_cells(const ca_engine *engine);
+// keeps the current generation alive past the next steps, for a reader on
+// another thread (e.g. a checkpoint writer); costs a pointer swap instead
+// of a copy. One at a time, NULL when one is already out or there is no
+// memory for the buffer that steps on in its place. Call
+// ca_release_cells() from the stepping thread when done with it.
+const float *ca_retain_cells(ca_engine *engine);
+void ca_release_cells(ca_engine *engine, const float *cells);
+
+// rule, stats and RNG state; ca_set_state() returns 0 when the grid
+// size does not match the engine or the rule does not fit in memory
+void ca_get_state(const ca_engine *engine, ca_state *state);
+int ca_set_state(ca_engine *engine, const ca_state *state, const float *cells);
+
+void ca_get_memory(const ca_engine *engine, ca_memory *memory);
+// one line for a HUD or a log
+void ca_memory_report(const ca_engine *engine, char *text, int len);
+
+const int *ca_size(const ca_engine *engine);
+int ca_dims(const ca_engine *engine);
+
+const ca_stats *ca_get_stats(const ca_engine *engine);
+void ca_set_detailed_stats(ca_engine *engine, int detailed);
+void ca_set_change_hook(ca_engine *engine, ca_change_hook hook, void *user);
+void ca_set_phase_hook(ca_engine *engine, ca_phase_hook hook, void *user);
+
+// INFINITE 2D WORLD
+// The original 2D rule (CA_RULE_LIFE, Conway or colour mode; other kinds
+// step as that too) on an unbounded plane. The plane is kept as
+// CA_CHUNK_SIZE square chunks, only where something lives, so memory and
+// step time follow the live area. Cells are addressed by world x, y
+// (negative too). The stats box is always filled, in world cells; the
+// histogram is not. Functions returning int give 0 when out of memory.
+#define CA_CHUNK_BITS  6
+#define CA_CHUNK_SIZE  (1 << CA_CHUNK_BITS)
+
+typedef struct ca_world ca_world;
+
+ca_world *ca_world_create(const ca_rule *rule);
+void ca_world_destroy(ca_world *world);
+
+void ca_world_set_rule(ca_world *world, const ca_rule *rule);
+const ca_rule *ca_world_get_rule(const ca_world *world);
+void ca_world_set_seed(ca_world *world, unsigned long long seed);
+
+void ca_world_clear(ca_world *world);
+int ca_world_set_cell(ca_world *world, int x, int y, float cell);
+float ca_world_get_cell(const ca_world *world, int x, int y);
+// random cells (as ca_fill_random) in a width x height window at x, y,
+// resets the iteration count
+int ca_world_fill_random(ca_world *world, int x, int y, int width, int height);
+
+int ca_world_step(ca_world *world, int generations);
+
+// copies a width x height window at x, y into cells, laid out like
+// ca_cells(): cells[i * height + j] is world cell x + i, y + j
+void ca_world_read(const ca_world *world, int x, int y, int width, int height, float *cells);
+
+const ca_stats *ca_world_get_stats(const ca_world *world);
+int ca_world_set_isa(ca_world *world, int isa);
+int ca_world_get_isa(const ca_world *world);
+// live chunks, and how many wait in the pool
+int ca_world_chunks(const ca_world *world, int *pooled);
+void ca_world_report(const ca_world *world, char *text, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
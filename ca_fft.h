@@ -0,0 +1,312 @@
+// ----------------------------------------
+// Cellular Automaton Engine - FFT convolution
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Small radix-2 FFT used by the continuous (Lenia) mode to convolve the
+// grid with large kernels in O(N log N). Real fields are transformed with
+// a real-to-complex pass along the last (contiguous) axis and complex
+// passes along the others. The plans (twiddles, bit reversal) and the
+// kernel spectrum are kept in fft_conv and reused every step.
+//
+// All sizes must be powers of two; pad the grid by the kernel radius
+// so the circular convolution does not wrap around.
+//
+// ----------------------------------------
+
+#ifndef CA_FFT_H
+#define CA_FFT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+typedef std::complex<float> fft_complex;
+
+struct fft_plan {
+  int n;
+  int *bitrev;
+  fft_complex *twiddle;   // exp(-2 pi i k / n), k < n/2
+};
+
+struct fft_conv {
+  int dims;
+  int size[3];            // real sizes, last one is contiguous
+  int half;               // size[dims-1] / 2 + 1
+  long real_count;
+  long complex_count;
+  fft_plan plans[3];      // complex plans for the leading axes
+  fft_plan row_plan;      // size[dims-1] / 2, used by the real pass
+  fft_complex *row_twiddle; // exp(-2 pi i k / n) for the real pass, k <= n/2
+  fft_complex *spectrum;
+  fft_complex *kernel;
+  // one line of the longest leading axis per thread, the passes run on
+  // as many threads as there were at setup
+  int threads;
+  long line_stride;
+  fft_complex *lines;
+};
+
+// threads of the parallel passes, and the one running (1 and 0 when
+// built without OpenMP)
+static int fft_threads(){
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static int fft_thread(){
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+static int fft_size(int n){
+  int size = 2;
+  while (size < n) size *= 2;
+  return size;
+}
+
+// false when out of memory, fft_plan_free() cleans up either way
+static bool fft_plan_setup(fft_plan *plan, int n){
+  int bits = 0;
+  while ((1 << bits) < n) bits++;
+
+  plan->n = n;
+  plan->bitrev = (int*)malloc(n * sizeof(int));
+  plan->twiddle = (fft_complex*)malloc((n / 2 + 1) * sizeof(fft_complex));
+  if (!plan->bitrev or !plan->twiddle) return false;
+  for (int i = 0; i < n; i++){
+    int r = 0;
+    for (int b = 0; b < bits; b++){
+      if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+    }
+    plan->bitrev[i] = r;
+  }
+  for (int k = 0; k < n / 2 + 1; k++){
+    plan->twiddle[k] = std::polar(1.0f, (float)(-2.0 * M_PI * k / n));
+  }
+  return true;
+}
+
+static void fft_plan_free(fft_plan *plan){
+  free(plan->bitrev);
+  free(plan->twiddle);
+  plan->bitrev = NULL;
+  plan->twiddle = NULL;
+}
+
+// in place, unnormalized
+static void fft_run(const fft_plan *plan, fft_complex *data, bool inverse){
+  int n = plan->n;
+
+  for (int i = 0; i < n; i++){
+    int j = plan->bitrev[i];
+    if (i < j){
+      fft_complex t = data[i];
+      data[i] = data[j];
+      data[j] = t;
+    }
+  }
+  for (int len = 2; len <= n; len *= 2){
+    int step = n / len;
+    for (int i = 0; i < n; i += len){
+      for (int k = 0; k < len / 2; k++){
+        fft_complex w = plan->twiddle[k * step];
+        if (inverse) w = std::conj(w);
+        fft_complex a = data[i + k];
+        fft_complex b = data[i + k + len / 2] * w;
+        data[i + k] = a + b;
+        data[i + k + len / 2] = a - b;
+      }
+    }
+  }
+}
+
+// n real values -> n/2+1 complex, through one complex FFT of size n/2
+static void fft_real_row(const fft_conv *conv, const float *in, fft_complex *out){
+  int m = conv->row_plan.n;
+  fft_complex *z = out;
+
+  for (int k = 0; k < m; k++){
+    z[k] = fft_complex(in[2*k], in[2*k + 1]);
+  }
+  fft_run(&conv->row_plan, z, false);
+
+  fft_complex last = z[0];
+  for (int k = 0; k <= m / 2; k++){
+    fft_complex zk = z[k];
+    fft_complex zm = z[(m - k) % m];
+    fft_complex e0 = (zk + std::conj(zm)) * 0.5f;
+    fft_complex o0 = (zk - std::conj(zm)) * fft_complex(0.0f, -0.5f);
+    fft_complex e1 = (zm + std::conj(zk)) * 0.5f;
+    fft_complex o1 = (zm - std::conj(zk)) * fft_complex(0.0f, -0.5f);
+    z[k] = e0 + conv->row_twiddle[k] * o0;
+    if (k > 0) z[m - k] = e1 + conv->row_twiddle[m - k] * o1;
+  }
+  z[m] = fft_complex(last.real() - last.imag(), 0.0f);
+}
+
+// inverse of fft_real_row, scaled by n like an unnormalized inverse
+static void fft_real_row_inverse(const fft_conv *conv, fft_complex *in, float *out){
+  int m = conv->row_plan.n;
+  fft_complex *z = in;
+
+  for (int k = 0; k <= m / 2; k++){
+    fft_complex xk = z[k];
+    fft_complex xm = z[m - k];
+    fft_complex e0 = xk + std::conj(xm);
+    fft_complex o0 = (xk - std::conj(xm)) * std::conj(conv->row_twiddle[k]);
+    fft_complex e1 = xm + std::conj(xk);
+    fft_complex o1 = (xm - std::conj(xk)) * std::conj(conv->row_twiddle[m - k]);
+    z[k] = e0 + fft_complex(0.0f, 1.0f) * o0;
+    if (k > 0) z[m - k] = e1 + fft_complex(0.0f, 1.0f) * o1;
+  }
+  fft_run(&conv->row_plan, z, true);
+  for (int k = 0; k < m; k++){
+    out[2*k] = z[k].real();
+    out[2*k + 1] = z[k].imag();
+  }
+}
+
+// complex passes over every leading axis of the half spectrum
+static void fft_leading_axes(const fft_conv *conv, fft_complex *data, bool inverse){
+  for (int axis = 0; axis < conv->dims - 1; axis++){
+    int n = conv->size[axis];
+    long stride = conv->half;
+    for (int a = axis + 1; a < conv->dims - 1; a++) stride *= conv->size[a];
+    long lines = conv->complex_count / n;
+
+    #pragma omp parallel num_threads(conv->threads)
+    {
+      fft_complex *line = conv->lines + fft_thread() * conv->line_stride;
+      #pragma omp for
+      for (long l = 0; l < lines; l++){
+        long inner = l % stride;
+        long outer = l / stride;
+        fft_complex *base = data + outer * stride * n + inner;
+        for (int i = 0; i < n; i++) line[i] = base[i * stride];
+        fft_run(&conv->plans[axis], line, inverse);
+        for (int i = 0; i < n; i++) base[i * stride] = line[i];
+      }
+    }
+  }
+}
+
+static void fft_forward(const fft_conv *conv, const float *in, fft_complex *out){
+  int n = conv->size[conv->dims - 1];
+  long rows = conv->real_count / n;
+
+  // each row is packed into n/2 complex values first, which fits into
+  // its n/2+1 slot of the output
+  #pragma omp parallel for
+  for (long r = 0; r < rows; r++){
+    fft_real_row(conv, in + r * n, out + r * conv->half);
+  }
+  fft_leading_axes(conv, out, false);
+}
+
+// destroys the spectrum, the result is normalized
+static void fft_inverse(const fft_conv *conv, fft_complex *in, float *out){
+  int n = conv->size[conv->dims - 1];
+  long rows = conv->real_count / n;
+  float scale = 1.0f / conv->real_count;
+
+  fft_leading_axes(conv, in, true);
+  #pragma omp parallel for
+  for (long r = 0; r < rows; r++){
+    float *row = out + r * n;
+    fft_real_row_inverse(conv, in + r * conv->half, row);
+    for (int i = 0; i < n; i++) row[i] *= scale;
+  }
+}
+
+static void fft_conv_free(fft_conv *conv){
+  for (int i = 0; i < 3; i++) fft_plan_free(&conv->plans[i]);
+  fft_plan_free(&conv->row_plan);
+  free(conv->row_twiddle);
+  free(conv->spectrum);
+  free(conv->kernel);
+  free(conv->lines);
+  conv->row_twiddle = NULL;
+  conv->spectrum = NULL;
+  conv->kernel = NULL;
+  conv->lines = NULL;
+}
+
+// sizes are rounded up to powers of two; plans are kept when the size
+// did not change. False when out of memory, conv is left empty then.
+static bool fft_conv_setup(fft_conv *conv, int dims, const int *size){
+  int rounded[3];
+  bool same = conv->spectrum and conv->dims == dims;
+
+  for (int i = 0; i < dims; i++){
+    rounded[i] = fft_size(size[i]);
+    if (conv->spectrum and rounded[i] != conv->size[i]) same = false;
+  }
+  if (same) return true;
+
+  fft_conv_free(conv);
+  conv->dims = dims;
+  conv->real_count = 1;
+  for (int i = 0; i < dims; i++){
+    conv->size[i] = rounded[i];
+    conv->real_count *= rounded[i];
+  }
+  int n = conv->size[dims - 1];
+  conv->half = n / 2 + 1;
+  conv->complex_count = conv->real_count / n * conv->half;
+
+  // lines a cache line apart, so neighbouring threads do not share one
+  int longest = 1;
+  for (int i = 0; i < dims - 1; i++){
+    if (conv->size[i] > longest) longest = conv->size[i];
+  }
+  conv->threads = fft_threads();
+  conv->line_stride = (longest + 7) & ~7;
+
+  bool ok = fft_plan_setup(&conv->row_plan, n / 2);
+  for (int i = 0; i < dims - 1; i++){
+    ok = ok and fft_plan_setup(&conv->plans[i], conv->size[i]);
+  }
+  conv->row_twiddle = (fft_complex*)malloc((n / 2 + 1) * sizeof(fft_complex));
+  conv->spectrum = (fft_complex*)malloc(conv->complex_count * sizeof(fft_complex));
+  conv->kernel = (fft_complex*)malloc(conv->complex_count * sizeof(fft_complex));
+  conv->lines = (fft_complex*)malloc(conv->threads * conv->line_stride * sizeof(fft_complex));
+  if (!ok or !conv->row_twiddle or !conv->spectrum or !conv->kernel or !conv->lines){
+    fft_conv_free(conv);
+    return false;
+  }
+  for (int k = 0; k <= n / 2; k++){
+    conv->row_twiddle[k] = std::polar(1.0f, (float)(-2.0 * M_PI * k / n));
+  }
+  return true;
+}
+
+// kernel is a real array of the padded size with the centre at index 0
+// (negative offsets wrap around); its spectrum is cached
+static void fft_conv_set_kernel(fft_conv *conv, const float *kernel){
+  fft_forward(conv, kernel, conv->kernel);
+}
+
+// field = field (*) kernel, in place on the padded real array
+static void fft_conv_apply(fft_conv *conv, float *field){
+  fft_forward(conv, field, conv->spectrum);
+  #pragma omp parallel for
+  for (long i = 0; i < conv->complex_count; i++){
+    conv->spectrum[i] *= conv->kernel[i];
+  }
+  fft_inverse(conv, conv->spectrum, field);
+}
+
+#endif
@@ -0,0 +1,575 @@
+// ----------------------------------------
+// Cellular Automaton Engine - pattern import
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Reads patterns into a grid, an engine or a world, a cell at a time as
+// the file streams past (64 kB reads, never the whole file):
+//
+//   Life RLE       x = 3, y = 3, rule = B3/S23 / bo$2bo$3o!
+//   Macrocell      [M2] quadtree from Golly; only the nodes are kept, the
+//                  cells are written out from the tree at the end
+//   voxel list     3D: optional "size W H D", then "x y z [value]" lines
+//
+// '#' starts a comment line in all three. The pattern goes to an offset,
+// or is centred on it when the size is known up front (the RLE header,
+// the Macrocell bounding box, a voxel list "size" line). RLE and Macrocell
+// rows run downwards, the grids upwards, so they are flipped to look the
+// same as in other programs.
+//
+// ----------------------------------------
+
+#ifndef CA_IMPORT_H
+#define CA_IMPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "ca_engine.h"
+
+static const int IMPORT_READ_BYTES    = 1 << 16;
+static const int IMPORT_MAX_LEVEL     = 60;
+static const long long IMPORT_NO_CELL = 0x7fffffffffffffffLL;
+
+// where the cells go: run cells from x, y, z of the target towards +x
+typedef void (*import_sink)(void *user, int x, int y, int z, int run, float cell);
+
+struct import_target {
+  import_sink sink;
+  void *user;
+  // the offset (or centre, see centre), and the value of a live cell
+  int at[3];
+  bool centre;
+  float alive;
+  // only this box of the target is written, [min, max)
+  long long clip_min[3];
+  long long clip_max[3];
+  // filled in while reading: pattern size (0 when unknown), rule, cells
+  int size[3];
+  char rule[64];
+  long cells;
+  int origin[3];
+};
+
+// READER
+// ----------------------------------------
+
+struct import_reader {
+  FILE *file;
+  const char *path;
+  unsigned char *bytes;
+  int pos;
+  int len;
+  int line;
+};
+
+static bool import_fill(import_reader *r){
+  r->len = fread(r->bytes, 1, IMPORT_READ_BYTES, r->file);
+  r->pos = 0;
+  if (r->len > 0) return true;
+  r->len = 0;
+  return false;
+}
+
+static inline int import_peek(import_reader *r){
+  if (r->pos == r->len and !import_fill(r)) return EOF;
+  return r->bytes[r->pos];
+}
+
+static inline int import_next(import_reader *r){
+  if (r->pos == r->len and !import_fill(r)) return EOF;
+  int c = r->bytes[r->pos++];
+  if (c == '\n') r->line++;
+  return c;
+}
+
+static inline bool import_digit(int c){
+  return (unsigned)(c - '0') < 10;
+}
+
+static void import_skip_line(import_reader *r){
+  int c;
+  do {
+    c = import_next(r);
+  } while (c != '\n' and c != EOF);
+}
+
+// the rest of the line into text (cut to len), without the newline
+static void import_read_line(import_reader *r, char *text, int len){
+  int used = 0;
+  for (int c = import_next(r); c != '\n' and c != EOF; c = import_next(r)){
+    if (used < len - 1 and c != '\r') text[used++] = c;
+  }
+  text[used] = '\0';
+}
+
+static void import_skip_blanks(import_reader *r){
+  int c = import_peek(r);
+  while (c == ' ' or c == '\t' or c == '\r'){
+    import_next(r);
+    c = import_peek(r);
+  }
+}
+
+// a signed integer after blanks on the same line
+static bool import_integer(import_reader *r, long long *value){
+  import_skip_blanks(r);
+  bool negative = import_peek(r) == '-';
+  if (negative) import_next(r);
+  if (!import_digit(import_peek(r))) return false;
+  long long v = 0;
+  while (import_digit(import_peek(r))){
+    v = v * 10 + (import_next(r) - '0');
+  }
+  *value = negative ? -v : v;
+  return true;
+}
+
+static bool import_error(import_reader *r, const char *what){
+  fprintf(stderr, "%s:%i: %s\n", r->path, r->line, what);
+  return false;
+}
+
+// skips '#' lines and blank lines, '#' lines go to comment when given
+static int import_skip_comments(import_reader *r, void (*comment)(import_target*, const char*), import_target *t){
+  char text[256];
+  for (int c = import_peek(r); c != EOF; c = import_peek(r)){
+    if (c == '#'){
+      import_read_line(r, text, sizeof(text));
+      if (comment) comment(t, text);
+    }else if (c == '\n' or c == '\r' or c == ' ' or c == '\t'){
+      import_next(r);
+    }else{
+      return c;
+    }
+  }
+  return EOF;
+}
+
+// PLACEMENT
+// ----------------------------------------
+
+// fixes where pattern cell 0, 0, 0 lands once the size is known
+static void import_place(import_target *t){
+  for (int i = 0; i < 3; i++){
+    t->origin[i] = t->centre ? t->at[i] - t->size[i] / 2 : t->at[i];
+  }
+}
+
+// run cells along x from pattern cell x, y, z
+static inline void import_cells(import_target *t, long long x, long long y, long long z, long long run, float cell){
+  x += t->origin[0];
+  y += t->origin[1];
+  z += t->origin[2];
+  if (y < t->clip_min[1] or z < t->clip_min[2] or y >= t->clip_max[1] or z >= t->clip_max[2]) return;
+  long long end = x + run < t->clip_max[0] ? x + run : t->clip_max[0];
+  if (x < t->clip_min[0]) x = t->clip_min[0];
+  if (x >= end) return;
+  t->sink(t->user, x, y, z, end - x, cell);
+  t->cells += end - x;
+}
+
+// RLE
+// ----------------------------------------
+
+static void import_rle_comment(import_target *t, const char *text){
+  // #r is the old spelling of the rule line
+  if (text[1] == 'r') snprintf(t->rule, sizeof(t->rule), "%s", text + 2 + strspn(text + 2, " "));
+}
+
+static bool import_rle(import_reader *r, import_target *t){
+  char header[256];
+  import_skip_comments(r, import_rle_comment, t);
+  import_read_line(r, header, sizeof(header));
+  if (sscanf(header, " x = %d , y = %d", &t->size[0], &t->size[1]) != 2){
+    return import_error(r, "not an RLE header (x = W, y = H)");
+  }
+  const char *rule = strstr(header, "rule");
+  if (rule and (rule = strchr(rule, '='))){
+    rule += 1 + strspn(rule + 1, " ");
+    snprintf(t->rule, sizeof(t->rule), "%.*s", (int)strcspn(rule, " ,\r"), rule);
+  }
+  t->size[2] = 1;
+  import_place(t);
+
+  // rows go down in the file; row 0 is the top of the pattern
+  long long x = 0, row = 0, count = 0;
+  int top = t->size[1] - 1;
+  for (int c = import_next(r); c != EOF and c != '!'; c = import_next(r)){
+    if (import_digit(c)){
+      count = count * 10 + c - '0';
+      continue;
+    }
+    long long run = count > 0 ? count : 1;
+    count = 0;
+    if (c == 'b' or c == '.'){
+      x += run;
+    }else if (c == '$'){
+      row += run;
+      x = 0;
+    }else if (c == 'o' or (c >= 'A' and c <= 'X') or (c >= 'p' and c <= 'y')){
+      // multi-state letters: pA..yO are one state, any state is alive
+      if (c >= 'p' and c <= 'y') import_next(r);
+      import_cells(t, x, top - row, 0, run, t->alive);
+      x += run;
+    }else if (c == '#'){
+      import_skip_line(r);
+    }else if (!isspace(c)){
+      return import_error(r, "unexpected character in RLE data");
+    }
+  }
+  return true;
+}
+
+// MACROCELL
+// ----------------------------------------
+// node 0 is empty space. Level 3 nodes are 8x8 leaves ('.' dead, '*'
+// alive, '$' ends a row) in 2-state files, multi-state files go down to
+// level 1 nodes of four cell states. Children are nw, ne, sw, se. Every
+// node keeps the box of its live cells (x right and y down from its
+// north-west corner), so the pattern can be placed before any cell is
+// written.
+
+struct import_node {
+  int level;
+  int child[4];
+  unsigned long long bits;
+  long long box[4];
+};
+
+struct import_tree {
+  import_node *nodes;
+  int count;
+  int capacity;
+};
+
+static void import_box_empty(long long *box){
+  box[0] = box[1] = IMPORT_NO_CELL;
+  box[2] = box[3] = -IMPORT_NO_CELL;
+}
+
+static void import_box_add(long long *box, const long long *child, long long x, long long y){
+  if (child[0] > child[2]) return;
+  if (child[0] + x < box[0]) box[0] = child[0] + x;
+  if (child[1] + y < box[1]) box[1] = child[1] + y;
+  if (child[2] + x > box[2]) box[2] = child[2] + x;
+  if (child[3] + y > box[3]) box[3] = child[3] + y;
+}
+
+static import_node *import_tree_add(import_tree *tree){
+  if (tree->count == tree->capacity){
+    int capacity = tree->capacity ? tree->capacity * 2 : 1024;
+    import_node *nodes = (import_node*)realloc(tree->nodes, capacity * sizeof(import_node));
+    if (!nodes) return NULL;
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+  }
+  import_node *n = &tree->nodes[tree->count++];
+  memset(n, 0, sizeof(*n));
+  import_box_empty(n->box);
+  return n;
+}
+
+static bool import_mc_leaf(import_reader *r, import_node *n){
+  // soups make '.' and '*' a coin toss, so the cells go in without a
+  // branch and the box comes from the finished mask
+  unsigned long long bits = 0;
+  int x = 0, y = 0;
+  n->level = 3;
+  for (int c = import_next(r); c != '\n' and c != EOF; c = import_next(r)){
+    if (c == '.' or c == '*'){
+      if ((x | y) > 7) return import_error(r, "leaf larger than 8x8");
+      bits |= (unsigned long long)(c == '*') << (y * 8 + x);
+      x++;
+    }else if (c == '$'){
+      x = 0;
+      y++;
+    }else if (c != '\r'){
+      return import_error(r, "unexpected character in a leaf");
+    }
+  }
+  n->bits = bits;
+  if (bits){
+    unsigned long long columns = 0;
+    for (int row = 0; row < 8; row++){
+      columns |= (bits >> (row * 8)) & 0xff;
+    }
+    long long box[] = {__builtin_ctzll(columns), __builtin_ctzll(bits) / 8,
+                       63 - __builtin_clzll(columns), (63 - __builtin_clzll(bits)) / 8};
+    import_box_add(n->box, box, 0, 0);
+  }
+  return true;
+}
+
+static bool import_mc_node(import_reader *r, import_tree *tree, import_node *n){
+  long long level, child[4];
+  if (!import_integer(r, &level) or level < 1 or level > IMPORT_MAX_LEVEL){
+    return import_error(r, "bad node level");
+  }
+  n->level = level;
+  long long half = level > 1 ? 1LL << (level - 1) : 1;
+  for (int i = 0; i < 4; i++){
+    if (!import_integer(r, &child[i]) or child[i] < 0){
+      return import_error(r, "bad node child");
+    }
+    if (level == 1){
+      // cell states
+      n->child[i] = child[i];
+      if (child[i] == 0) continue;
+      long long cell[] = {i & 1, i >> 1, i & 1, i >> 1};
+      import_box_add(n->box, cell, 0, 0);
+      continue;
+    }
+    if (child[i] >= tree->count or (child[i] > 0 and tree->nodes[child[i]].level != level - 1)){
+      return import_error(r, "node child out of order");
+    }
+    n->child[i] = child[i];
+    if (child[i] > 0) import_box_add(n->box, tree->nodes[child[i]].box, (i & 1) * half, (i >> 1) * half);
+  }
+  import_skip_line(r);
+  return true;
+}
+
+// writes node at x, y (pattern cells, y down) into the target, skipping
+// empty space and anything outside the clip box
+static void import_mc_write(import_target *t, const import_tree *tree, int index, long long x, long long y, long long top){
+  const import_node *n = &tree->nodes[index];
+  if (index == 0 or n->box[0] > n->box[2]) return;
+  // the live box in target coordinates
+  long long min_x = t->origin[0] + x + n->box[0], max_x = t->origin[0] + x + n->box[2];
+  long long min_y = t->origin[1] + top - (y + n->box[3]), max_y = t->origin[1] + top - (y + n->box[1]);
+  if (max_x < t->clip_min[0] or min_x >= t->clip_max[0] or max_y < t->clip_min[1] or min_y >= t->clip_max[1]) return;
+  if (t->origin[2] < t->clip_min[2] or t->origin[2] >= t->clip_max[2]) return;
+
+  if (n->level == 3 and n->bits){
+    // a row of the leaf at a time, in runs of live cells
+    for (int row = 0; row < 8; row++){
+      unsigned bits = n->bits >> (row * 8) & 0xff;
+      while (bits){
+        int from = __builtin_ctz(bits);
+        int run = __builtin_ctz(~(bits >> from));
+        import_cells(t, x + from, top - (y + row), 0, run, t->alive);
+        bits &= ~(((1u << run) - 1) << from);
+      }
+    }
+    return;
+  }
+  if (n->level == 1){
+    for (int i = 0; i < 4; i++){
+      if (n->child[i]) import_cells(t, x + (i & 1), top - (y + (i >> 1)), 0, 1, t->alive);
+    }
+    return;
+  }
+  long long half = 1LL << (n->level - 1);
+  for (int i = 0; i < 4; i++){
+    import_mc_write(t, tree, n->child[i], x + (i & 1) * half, y + (i >> 1) * half, top);
+  }
+}
+
+static void import_mc_comment(import_target *t, const char *text){
+  if (text[1] == 'R') snprintf(t->rule, sizeof(t->rule), "%s", text + 2 + strspn(text + 2, " "));
+}
+
+static bool import_macrocell(import_reader *r, import_target *t){
+  char header[256];
+  import_tree tree = {NULL, 0, 0};
+  bool ok = true;
+
+  import_read_line(r, header, sizeof(header));
+  if (strncmp(header, "[M2]", 4) != 0) return import_error(r, "not a Macrocell file ([M2])");
+  import_tree_add(&tree);
+  for (int c = import_skip_comments(r, import_mc_comment, t); c != EOF and ok; c = import_skip_comments(r, import_mc_comment, t)){
+    import_node *n = import_tree_add(&tree);
+    if (!n){
+      ok = import_error(r, "out of memory");
+    }else if (c == '.' or c == '*' or c == '$'){
+      ok = import_mc_leaf(r, n);
+    }else{
+      ok = import_mc_node(r, &tree, n);
+    }
+  }
+  if (ok and tree.count < 2) ok = import_error(r, "no nodes");
+
+  if (ok){
+    // the root is the last node; its bounding box is the pattern
+    int root = tree.count - 1;
+    const long long *box = tree.nodes[root].box;
+    if (box[0] <= box[2]){
+      t->size[0] = box[2] - box[0] + 1;
+      t->size[1] = box[3] - box[1] + 1;
+      t->size[2] = 1;
+      import_place(t);
+      import_mc_write(t, &tree, root, -box[0], -box[1], box[3] - box[1]);
+    }
+  }
+  free(tree.nodes);
+  return ok;
+}
+
+// VOXEL LIST
+// ----------------------------------------
+
+static bool import_voxels(import_reader *r, import_target *t){
+  char token[32];
+  bool placed = false;
+
+  for (int c = import_skip_comments(r, NULL, NULL); c != EOF; c = import_skip_comments(r, NULL, NULL)){
+    if (c == 's'){
+      // size W H D, before the first voxel
+      import_read_line(r, token, sizeof(token));
+      if (placed or sscanf(token, "size %d %d %d", &t->size[0], &t->size[1], &t->size[2]) != 3){
+        return import_error(r, "expected size W H D before the voxels");
+      }
+      continue;
+    }
+    if (!placed){
+      import_place(t);
+      placed = true;
+    }
+    long long p[3];
+    for (int i = 0; i < 3; i++){
+      if (!import_integer(r, &p[i])) return import_error(r, "expected x y z [value]");
+    }
+    float cell = t->alive;
+    import_skip_blanks(r);
+    int used = 0;
+    for (c = import_peek(r); c != '\n' and c != EOF and !isspace(c); c = import_peek(r)){
+      if (used < (int)sizeof(token) - 1) token[used++] = c;
+      import_next(r);
+    }
+    token[used] = '\0';
+    if (used > 0) cell = strtof(token, NULL);
+    import_skip_line(r);
+    if (cell != 0.0f) import_cells(t, p[0], p[1], p[2], 1, cell);
+  }
+  return true;
+}
+
+// FILES
+// ----------------------------------------
+
+// RLE, Macrocell or a voxel list, told apart by the first line that is
+// not a comment
+static bool import_pattern(const char *path, import_target *t){
+  import_reader r = {NULL, path, NULL, 0, 0, 1};
+  r.file = fopen(path, "rb");
+  if (!r.file){
+    perror(path);
+    return false;
+  }
+  r.bytes = (unsigned char*)malloc(IMPORT_READ_BYTES);
+  if (!r.bytes){
+    fprintf(stderr, "%s: out of memory\n", path);
+    fclose(r.file);
+    return false;
+  }
+  memset(t->size, 0, sizeof(t->size));
+  t->rule[0] = '\0';
+  t->cells = 0;
+
+  bool ok;
+  int c = import_peek(&r);
+  if (c == '['){
+    ok = import_macrocell(&r, t);
+  }else if (import_skip_comments(&r, import_rle_comment, t) == 'x'){
+    ok = import_rle(&r, t);
+  }else{
+    ok = import_voxels(&r, t);
+  }
+  if (ok and ferror(r.file)){
+    perror(path);
+    ok = false;
+  }
+  free(r.bytes);
+  fclose(r.file);
+  return ok;
+}
+
+static void import_target_setup(import_target *t, const int *at, bool centre, float alive){
+  memset(t, 0, sizeof(*t));
+  memcpy(t->at, at, sizeof(t->at));
+  t->centre = centre;
+  t->alive = alive;
+  for (int i = 0; i < 3; i++){
+    t->clip_min[i] = -0x7fffffffLL - 1;
+    t->clip_max[i] = 0x7fffffffLL;
+  }
+}
+
+// a grid laid out like ca_cells()
+struct import_grid {
+  float *cells;
+  const int *size;
+};
+
+static void import_to_grid(void *user, int x, int y, int z, int run, float cell){
+  import_grid *grid = (import_grid*)user;
+  long stride = (long)grid->size[1] * grid->size[2];
+  float *to = grid->cells + (long)x * stride + (long)y * grid->size[2] + z;
+  for (int i = 0; i < run; i++, to += stride){
+    *to = cell;
+  }
+}
+
+// a world, failed once a chunk could not be allocated
+struct import_world {
+  ca_world *world;
+  bool failed;
+};
+
+static void import_to_world(void *user, int x, int y, int z, int run, float cell){
+  import_world *to = (import_world*)user;
+  for (int i = 0; i < run and !to->failed; i++){
+    to->failed = !ca_world_set_cell(to->world, x + i, y, cell);
+  }
+}
+
+// a pattern in place of the engine's grid; at (or the centre of the grid
+// with centre set) is where it goes
+static bool import_into_engine(ca_engine *engine, const char *path, const int *at, bool centre, float alive, import_target *t){
+  const int *size = ca_size(engine);
+  import_target_setup(t, at, centre, alive);
+  for (int i = 0; i < 3; i++){
+    t->clip_min[i] = 0;
+    t->clip_max[i] = size[i];
+  }
+  import_grid grid = {(float*)calloc((long)size[0] * size[1] * size[2], sizeof(float)), size};
+  if (!grid.cells){
+    fprintf(stderr, "%s: out of memory\n", path);
+    return false;
+  }
+  t->sink = import_to_grid;
+  t->user = &grid;
+  bool ok = import_pattern(path, t);
+  if (ok) ca_set_cells(engine, grid.cells);
+  free(grid.cells);
+  return ok;
+}
+
+static inline bool import_into_world(ca_world *world, const char *path, const int *at, bool centre, float alive, import_target *t){
+  import_target_setup(t, at, centre, alive);
+  // the world is flat, a voxel list leaves only its z = 0 layer
+  t->clip_min[2] = 0;
+  t->clip_max[2] = 1;
+  ca_world_clear(world);
+  import_world to = {world, false};
+  t->sink = import_to_world;
+  t->user = &to;
+  bool ok = import_pattern(path, t);
+  if (ok and to.failed){
+    fprintf(stderr, "%s: out of memory\n", path);
+    ok = false;
+  }
+  return ok;
+}
+
+// B3/S23 in any spelling, or no rule at all
+static inline bool import_is_life(const import_target *t){
+  return t->rule[0] == '\0' or strcasecmp(t->rule, "B3/S23") == 0 or strcasecmp(t->rule, "23/3") == 0 or strcasecmp(t->rule, "life") == 0;
+}
+
+#endif
@@ -0,0 +1,370 @@
+// ----------------------------------------
+// Cellular Automaton Engine - distributed (MPI)
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Repo:
+// https://github.com/w84death/cellular-automaton
+//
+// Headless version of the 2D/3D simulation for grids that do not fit
+// in one machine. The grid is cut into slabs along X, every rank owns
+// one slab and swaps one-cell halos with its neighbours each generation.
+//
+// Linux:
+// mpicxx -O2 ca_mpi.cpp -o ca_mpi.app
+//
+// Usage:
+// mpirun -np 4 ./ca_mpi.app 84x48 100          (2D colour mode)
+// mpirun -np 4 ./ca_mpi.app 84x48 100 conway   (2D Conway mode)
+// mpirun -np 4 ./ca_mpi.app 36x36x36 100       (3D)
+//
+// ----------------------------------------
+
+// LIBS
+// ----------------------------------------------------------------------------
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// SYSTEM VARS
+// ----------------------------------------------------------------------------
+
+int rank              = 0;
+int ranks             = 1;
+int generations       = 100;
+bool mode_3d          = false;
+bool automation_mode  = false;
+
+// AUTOMATON VARS
+// ----------------------------------------------------------------------------
+
+int CELLS_ARRAY_SIZE[]  = {84, 48, 1};
+long MAX_CELLS          = 0;
+
+// local slab: x in [slab_x, slab_x + slab_size), plus one halo plane
+// on each side (local x = 0 and local x = slab_size + 1)
+int slab_x              = 0;
+int slab_size           = 0;
+long plane_size         = 0;
+float *cells_main_array   = NULL;
+float *cells_buffer_array = NULL;
+
+// 2D rules (same as ca2d)
+static float CELL_START_COLOR = 0.5f;
+static float CELL_STEP_COLOUR = 0.005f;
+static float CELL_MIN_COLOUR  = 0.05f;
+static float CELL_MAX_COLOUR  = 1.0f;
+
+// 3D rules (same as ca3d)
+static float CELL_ALIVE       = 0.2f;
+static float CELL_DEAD        = 0.0f;
+static float CELL_MIN_COLOUR_3D  = 0.2f;
+static float CELL_MAX_COLOUR_3D  = 0.8f;
+static float CELL_STEP_COLOUR_3D = 0.05f;
+
+int stat_iteration      = 0;
+long stat_alive         = 0;
+long stat_change        = 0;
+
+// HELPERS
+// ----------------------------------------------------------------------------
+
+// random value hashed from the global cell position so the seeded grid
+// is the same no matter how many ranks are running
+float random_f(int x, int y, int z){
+  uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+  h ^= h >> 16; h *= 0x7feb352du;
+  h ^= h >> 15; h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return (float)(h & 0xffffff) / (float)0xffffff;
+}
+
+float random_fcolor(int x, int y, int z){
+  float r = random_f(z, x, y);
+  if (r < CELL_MIN_COLOUR_3D){
+    r = 0.0f;
+  }
+  if  (r > CELL_MAX_COLOUR_3D){
+    r = CELL_MAX_COLOUR_3D;
+  }
+  return r;
+}
+
+inline float *cell_at(float *array, int lx, int y, int z){
+  return array + lx * plane_size + (long)y * CELLS_ARRAY_SIZE[2] + z;
+}
+
+float cell_gain_colour(float colour, float step, float max){
+  float new_colour = colour + step;
+  if (new_colour > max){
+    new_colour = max;
+  }
+  return new_colour;
+}
+
+float cell_lose_colour(float colour, float step, float min){
+  float new_colour = colour - step;
+  if (new_colour < min){
+    new_colour = min;
+  }
+  return new_colour;
+}
+
+// DECOMPOSITION
+// ----------------------------------------------------------------------------
+
+void slab_setup(){
+  int base = CELLS_ARRAY_SIZE[0] / ranks;
+  int rest = CELLS_ARRAY_SIZE[0] % ranks;
+
+  slab_size = base + (rank < rest ? 1 : 0);
+  slab_x = rank * base + (rank < rest ? rank : rest);
+  plane_size = (long)CELLS_ARRAY_SIZE[1] * CELLS_ARRAY_SIZE[2];
+  MAX_CELLS = (long)CELLS_ARRAY_SIZE[0] * plane_size;
+
+  long local = (slab_size + 2) * plane_size;
+  cells_main_array = (float*)calloc(local, sizeof(float));
+  cells_buffer_array = (float*)calloc(local, sizeof(float));
+  if (!cells_main_array or !cells_buffer_array){
+    fprintf(stderr, "rank %i: out of memory for %li cells\n", rank, local);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+}
+
+// halos on the global edges are never received and stay dead, which is
+// the same as the bounds check in count_cells()
+void halo_exchange_begin(MPI_Request *requests, int *count){
+  int left = rank - 1;
+  int right = rank + 1;
+  *count = 0;
+
+  if (left >= 0){
+    MPI_Irecv(cell_at(cells_main_array, 0, 0, 0), plane_size, MPI_FLOAT,
+      left, 0, MPI_COMM_WORLD, &requests[(*count)++]);
+    MPI_Isend(cell_at(cells_main_array, 1, 0, 0), plane_size, MPI_FLOAT,
+      left, 1, MPI_COMM_WORLD, &requests[(*count)++]);
+  }
+  if (right < ranks){
+    MPI_Irecv(cell_at(cells_main_array, slab_size + 1, 0, 0), plane_size, MPI_FLOAT,
+      right, 1, MPI_COMM_WORLD, &requests[(*count)++]);
+    MPI_Isend(cell_at(cells_main_array, slab_size, 0, 0), plane_size, MPI_FLOAT,
+      right, 0, MPI_COMM_WORLD, &requests[(*count)++]);
+  }
+}
+
+// SIMULATION
+// ----------------------------------------------------------------------------
+
+void simulation_setup(){
+  for (int lx = 1; lx <= slab_size; lx++){
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+    int x = slab_x + lx - 1;
+    float *cell = cell_at(cells_main_array, lx, y, z);
+    if (!mode_3d){
+      *cell = (random_f(x, y, z) >= 0.85f) ? CELL_START_COLOR : 0.0f;
+      continue;
+    }
+    *cell = CELL_DEAD;
+    if (z>CELLS_ARRAY_SIZE[2]*0.20 and z < CELLS_ARRAY_SIZE[2]*0.80){
+    if (y>CELLS_ARRAY_SIZE[1]*0.20 and y < CELLS_ARRAY_SIZE[1]*0.80){
+    if (x>CELLS_ARRAY_SIZE[0]*0.20 and x < CELLS_ARRAY_SIZE[0]*0.80){
+      *cell = (random_f(x, y, z) > 0.85f) ? random_fcolor(x, y, z) : CELL_DEAD;
+    }}}
+  }}}
+  stat_iteration = 0;
+}
+
+int count_cells(int lx, int cy, float treshold){
+  int count = 0;
+
+  for (int x = lx-1; x <= lx+1; x++){
+  for (int y = cy-1; y <= cy+1; y++){
+    if (y >= 0 and y < CELLS_ARRAY_SIZE[1] and !(x == lx and y == cy)){
+      if (*cell_at(cells_main_array, x, y, 0) > treshold){
+        count++;
+      }
+    }
+  }}
+
+  return count;
+}
+
+// 3x3x3 block without the centre and the eight corners, see
+// simulation_count_neigbours() in ca3d
+int count_neigbours(int lx, int cy, int cz, float treshold){
+  int neigbours = 0;
+
+  for (int x = lx-1; x <= lx+1; x++){
+  for (int y = cy-1; y <= cy+1; y++){
+  for (int z = cz-1; z <= cz+1; z++){
+    if (y < 0 or z < 0 or y >= CELLS_ARRAY_SIZE[1] or z >= CELLS_ARRAY_SIZE[2]) continue;
+    int off = (x != lx) + (y != cy) + (z != cz);
+    if (off == 0 or off == 3) continue;
+    if (*cell_at(cells_main_array, x, y, z) >= treshold){
+      neigbours++;
+    }
+  }}}
+
+  return neigbours;
+}
+
+float rule_2d(float cell, int lx, int y){
+  if (automation_mode){
+    int count = count_cells(lx, y, 0.0f);
+    if (cell > 0.0f){
+      if (count < 2 or count > 3) return 0.0f;
+      return cell_gain_colour(cell, CELL_STEP_COLOUR, CELL_MAX_COLOUR);
+    }
+    return count == 3 ? CELL_START_COLOR : 0.0f;
+  }
+
+  int count = count_cells(lx, y, 0.3f);
+  if (cell > 0.2f){
+    if (count < 2 or count > 3) return cell_lose_colour(cell, CELL_STEP_COLOUR, CELL_MIN_COLOUR);
+    return cell_gain_colour(cell, CELL_STEP_COLOUR, CELL_MAX_COLOUR);
+  }
+  return count == 3 ? cell_gain_colour(cell, CELL_STEP_COLOUR, CELL_MAX_COLOUR) : 0.0f;
+}
+
+float rule_3d(float cell, int lx, int y, int z){
+  int neigbours = count_neigbours(lx, y, z, CELL_ALIVE);
+  if (cell > CELL_ALIVE){
+    if (neigbours < 2 or neigbours > 6){
+      return cell_lose_colour(cell, CELL_STEP_COLOUR_3D, CELL_MIN_COLOUR_3D);
+    }
+    return cell_gain_colour(cell, CELL_STEP_COLOUR_3D, CELL_MAX_COLOUR_3D);
+  }
+  if (neigbours == 5){
+    return cell_gain_colour(cell, CELL_STEP_COLOUR_3D, CELL_MAX_COLOUR_3D);
+  }
+  return CELL_DEAD;
+}
+
+// one X plane of the slab, stats are counted on the way
+void simulation_do_plane(int lx, long *alive, long *change){
+  float alive_treshold = mode_3d ? CELL_ALIVE : 0.0f;
+
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+    float cell = *cell_at(cells_main_array, lx, y, z);
+    float new_cell = mode_3d ? rule_3d(cell, lx, y, z) : rule_2d(cell, lx, y);
+    *cell_at(cells_buffer_array, lx, y, z) = new_cell;
+    if (new_cell > alive_treshold) (*alive)++;
+    if (new_cell != cell) (*change)++;
+  }}
+}
+
+void simulation_loop(){
+  MPI_Request requests[4];
+  int count;
+  long local_stats[2] = {0, 0};
+
+  halo_exchange_begin(requests, &count);
+
+  // interior planes do not touch the halos, so they run while the
+  // exchange is in flight
+  for (int lx = 2; lx < slab_size; lx++){
+    simulation_do_plane(lx, &local_stats[0], &local_stats[1]);
+  }
+
+  MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+
+  simulation_do_plane(1, &local_stats[0], &local_stats[1]);
+  if (slab_size > 1){
+    simulation_do_plane(slab_size, &local_stats[0], &local_stats[1]);
+  }
+
+  float *swap = cells_main_array;
+  cells_main_array = cells_buffer_array;
+  cells_buffer_array = swap;
+
+  if (stat_alive > 0){
+    stat_iteration++;
+  }
+
+  long global_stats[2];
+  MPI_Allreduce(local_stats, global_stats, 2, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+  stat_alive = global_stats[0];
+  stat_change = global_stats[1];
+}
+
+// MAIN
+// ----------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  if (argc > 1){
+    int dims = sscanf(argv[1], "%ix%ix%i", &CELLS_ARRAY_SIZE[0], &CELLS_ARRAY_SIZE[1], &CELLS_ARRAY_SIZE[2]);
+    if (dims < 2){
+      if (rank == 0) fprintf(stderr, "usage: %s WxH[xD] [generations] [conway]\n", argv[0]);
+      MPI_Finalize();
+      return 1;
+    }
+    mode_3d = dims == 3;
+    if (!mode_3d) CELLS_ARRAY_SIZE[2] = 1;
+  }
+  if (argc > 2){
+    generations = atoi(argv[2]);
+  }
+  if (argc > 3){
+    automation_mode = strcmp(argv[3], "conway") == 0;
+  }
+
+  if (CELLS_ARRAY_SIZE[0] < ranks){
+    if (rank == 0) fprintf(stderr, "grid is %i cells wide, can not split it into %i slabs\n", CELLS_ARRAY_SIZE[0], ranks);
+    MPI_Finalize();
+    return 1;
+  }
+
+  slab_setup();
+  simulation_setup();
+
+  double start = MPI_Wtime();
+  for (int i = 0; i < generations; i++){
+    simulation_loop();
+    if (rank == 0){
+      printf("ITERATION: [%i] ALIVE: [%li/%li] CHANGE: [%li]\n", stat_iteration, stat_alive, MAX_CELLS, stat_change);
+    }
+  }
+  double elapsed = MPI_Wtime() - start;
+
+  if (rank == 0){
+    printf("%i generations on %i ranks in %.3fs\n", generations, ranks, elapsed);
+  }
+
+  free(cells_main_array);
+  free(cells_buffer_array);
+  MPI_Finalize();
+  return 0;
+}
+
+
+
+// The MIT License (MIT)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
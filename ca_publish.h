@@ -0,0 +1,107 @@
+// ----------------------------------------
+// Cellular Automaton Engine - shared-memory publishing
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Publishes every finished generation into a POSIX shared-memory segment
+// so other processes on the machine can read the live grid. The segment
+// is a header followed by PUBLISH_SLOTS frames (ca_publish_layout.h),
+// each frame guarded by a seqlock. The simulation writes frame n into
+// slot n % PUBLISH_SLOTS and never waits for anybody; readers include
+// only the layout, map the segment read-only, use the frame in place and
+// check the sequence afterwards (see ca_watch.cpp):
+//
+// frame = latest; slot = frame % slots
+// s1 = slot.sequence            (2 * frame + 2 when the frame is complete)
+// ... read slot cells and stats ...
+// s2 = slot.sequence            (s1 == s2: the data was not overwritten)
+//
+// ----------------------------------------
+
+#ifndef CA_PUBLISH_H
+#define CA_PUBLISH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ca_publish_layout.h"
+
+static char publish_name[256];
+static publish_header *publish_map = NULL;
+static size_t publish_bytes = 0;
+static unsigned long long publish_frames = 0;
+
+static void publish_stop(){
+  if (!publish_map) return;
+  munmap(publish_map, publish_bytes);
+  shm_unlink(publish_name);
+  publish_map = NULL;
+}
+
+// name is a shm name like /ca2d; the segment is removed at exit
+static bool publish_start(const char *name, int dims, const int *size){
+  int count = size[0] * size[1] * (dims == 3 ? size[2] : 1);
+  unsigned cells_offset = publish_align(sizeof(publish_slot));
+  unsigned slot_bytes = publish_align(cells_offset + count * sizeof(float));
+
+  snprintf(publish_name, sizeof(publish_name), "%s%s", name[0] == '/' ? "" : "/", name);
+  publish_bytes = publish_align(sizeof(publish_header)) + (size_t)PUBLISH_SLOTS * slot_bytes;
+
+  int fd = shm_open(publish_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0){
+    perror(publish_name);
+    return false;
+  }
+  if (ftruncate(fd, publish_bytes) != 0){
+    perror(publish_name);
+    close(fd);
+    shm_unlink(publish_name);
+    return false;
+  }
+  void *map = mmap(NULL, publish_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED){
+    perror(publish_name);
+    shm_unlink(publish_name);
+    return false;
+  }
+
+  publish_map = (publish_header*)map;
+  publish_map->dims = dims;
+  for (int i = 0; i < 3; i++){
+    publish_map->size[i] = i < dims ? size[i] : 1;
+  }
+  publish_map->slots = PUBLISH_SLOTS;
+  publish_map->slot_bytes = slot_bytes;
+  publish_map->cells_offset = cells_offset;
+  publish_map->version = PUBLISH_VERSION;
+  publish_map->latest.store(~0ULL, std::memory_order_relaxed);
+  // readers check the magic last, so it goes in once the rest is set
+  std::atomic_thread_fence(std::memory_order_release);
+  publish_map->magic = PUBLISH_MAGIC;
+  atexit(publish_stop);
+  return true;
+}
+
+// copies one generation into the next slot; never waits for readers
+static void publish_frame(const float *cells, const ca_stats *stats){
+  if (!publish_map) return;
+  unsigned long long frame = publish_frames++;
+  publish_slot *slot = publish_get_slot(publish_map, frame % PUBLISH_SLOTS);
+  int count = publish_map->size[0] * publish_map->size[1] * publish_map->size[2];
+
+  slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->frame = frame;
+  slot->stats = *stats;
+  memcpy((char*)slot + publish_map->cells_offset, cells, count * sizeof(float));
+  slot->sequence.store(2 * frame + 2, std::memory_order_release);
+  publish_map->latest.store(frame, std::memory_order_release);
+}
+
+#endif
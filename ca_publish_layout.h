@@ -0,0 +1,53 @@
+// ----------------------------------------
+// Cellular Automaton Engine - shared-memory layout
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// The segment ca_publish.h writes, as readers see it: a header, then
+// PUBLISH_SLOTS frames of slot_bytes each. Readers include only this.
+//
+// ----------------------------------------
+
+#ifndef CA_PUBLISH_LAYOUT_H
+#define CA_PUBLISH_LAYOUT_H
+
+#include <stddef.h>
+#include <atomic>
+#include "ca_engine.h"
+
+static const unsigned PUBLISH_MAGIC   = 0x43414731; // "CAG1"
+static const unsigned PUBLISH_VERSION = 1;
+// a reader has PUBLISH_SLOTS - 1 generations to finish with a frame
+static const int PUBLISH_SLOTS        = 4;
+
+struct publish_slot {
+  // odd while the slot is written, 2 * frame + 2 once frame is complete
+  std::atomic<unsigned long long> sequence;
+  unsigned long long frame;
+  ca_stats stats;
+  // cells follow at publish_header.cells_offset from the slot start
+};
+
+struct publish_header {
+  unsigned magic;
+  unsigned version;
+  int dims;
+  int size[3];
+  int slots;
+  unsigned slot_bytes;
+  unsigned cells_offset;
+  // last complete frame, ~0 before the first one
+  std::atomic<unsigned long long> latest;
+};
+
+static size_t publish_align(size_t n){
+  return (n + 63) & ~(size_t)63;
+}
+
+static publish_slot *publish_get_slot(const publish_header *header, int i){
+  return (publish_slot*)((char*)header + publish_align(sizeof(publish_header)) + (size_t)i * header->slot_bytes);
+}
+
+#endif
@@ -0,0 +1,327 @@
+// ----------------------------------------
+// Cellular Automaton Engine - reference kernels
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// The original rules as ca2d (automation, automation2) and ca3d
+// (simulation_do_work) ran them before ca_engine: one cell at a time, no
+// threads, no vectors. Kept as they were so every faster path can be
+// checked against them (see ca_verify.cpp). The grid size is set at
+// runtime and the arrays are views over malloc'd cells; the rules and
+// the swap passes are untouched apart from dropping telemetry, LOD and
+// mesh updates.
+//
+// ----------------------------------------
+
+#ifndef CA_REFERENCE_H
+#define CA_REFERENCE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// 2D: automation() is the Conway mode, automation2() the colour mode
+namespace ref2d {
+
+int CELLS_ARRAY_SIZE[] = {84, 48};
+
+// cells_main_array[x][y] over cells[x * size[1] + y]
+struct grid {
+   float *cells;
+   float *operator[](int x){ return cells + (long)x * CELLS_ARRAY_SIZE[1]; }
+};
+
+grid cells_main_array         = {NULL};
+grid cells_buffer_array       = {NULL};
+
+static float CELL_START_COLOR = 0.5f;
+static float CELL_STEP_COLOUR = 0.005f;
+static float CELL_MIN_COLOUR  = 0.05f;
+static float CELL_MAX_COLOUR  = 1.0f;
+bool automation_mode          = false;
+int stat_iteration            = 0;
+int stat_alive                = 0;
+int stat_change               = 0;
+
+int count_cells(int cx, int cy, float treshold){
+   int count = 0;
+
+   for (int y = cy-1; y <= cy+1; y++){
+      for (int x = cx-1; x <= cx+1; x++){
+         if (x >= 0 and y >= 0 and x < CELLS_ARRAY_SIZE[0] and y < CELLS_ARRAY_SIZE[1] and !( x == cx and y == cy)){
+            if (cells_main_array[x][y] > treshold){
+               count++;
+            }
+         }
+      }
+   }
+
+   return count;
+}
+
+float cell_gain_colour(float colour, float step = CELL_STEP_COLOUR){
+   float new_colour = colour + step;
+   if (new_colour > CELL_MAX_COLOUR){
+      new_colour = CELL_MAX_COLOUR;
+   }
+   return new_colour;
+}
+
+float cell_lose_colour(float colour, float step = CELL_STEP_COLOUR){
+   float new_colour = colour - step;
+   if (new_colour < CELL_MIN_COLOUR){
+      new_colour = CELL_MIN_COLOUR;
+   }
+   return new_colour;
+}
+
+void automation(){
+   int count;
+   float cell;
+   float new_cell;
+
+   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+         count = count_cells(x, y, 0.0f);
+         cell = cells_main_array[x][y];
+         if (cell > 0.0f){
+            if (count < 2 or count > 3){
+               new_cell = 0.0f;
+            }else{
+               new_cell = cell_gain_colour(cell);
+            }
+         }else{
+            if (count == 3){
+               new_cell = CELL_START_COLOR;
+            }else{
+               new_cell = 0.0f;
+            }
+         }
+         cells_buffer_array[x][y] = new_cell;
+      }
+   }
+}
+
+void automation2(){
+   int count;
+   float cell;
+   float new_cell;
+
+   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+         count = count_cells(x, y, 0.3f);
+         cell = cells_main_array[x][y];
+         if (cell > 0.2f){
+            if (count < 2 or count > 3){
+               new_cell = cell_lose_colour(cell);
+            }else{
+               new_cell = cell_gain_colour(cell);
+            }
+         }else{
+            if (count == 3){
+               new_cell = cell_gain_colour(cell);
+            }else{
+               new_cell = 0.0f;
+            }
+         }
+         cells_buffer_array[x][y] = new_cell;
+      }
+   }
+}
+
+void swap_arrays(){
+   float old_cell;
+   float new_cell;
+   stat_alive = 0;
+   stat_change = 0;
+
+   for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+      for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+         old_cell = cells_main_array[x][y];
+         new_cell = cells_buffer_array[x][y];
+         cells_main_array[x][y] = new_cell;
+         if (new_cell > 0.0f){
+            stat_alive++;
+         }
+         if (old_cell != new_cell){
+            stat_change++;
+         }
+      }
+   }
+}
+
+void run_automation(){
+   if (automation_mode){
+      automation();
+   }else{
+      automation2();
+   }
+   if (stat_alive > 0) {
+      stat_iteration++;
+   }
+   swap_arrays();
+}
+
+// a w x h grid with the given cells (cells[x * h + y]), stats cleared
+void setup(int w, int h, bool conway, const float *cells){
+   CELLS_ARRAY_SIZE[0] = w;
+   CELLS_ARRAY_SIZE[1] = h;
+   automation_mode = conway;
+   free(cells_main_array.cells);
+   free(cells_buffer_array.cells);
+   cells_main_array.cells = (float*)malloc((long)w * h * sizeof(float));
+   cells_buffer_array.cells = (float*)calloc((long)w * h, sizeof(float));
+   memcpy(cells_main_array.cells, cells, (long)w * h * sizeof(float));
+   stat_iteration = stat_alive = stat_change = 0;
+}
+
+}
+
+// 3D: simulation_do_work(), the 18 cell rule
+namespace ref3d {
+
+int CELLS_ARRAY_SIZE[] = {36, 36, 36};
+
+// cells_main_array[x][y][z] over cells[(x * size[1] + y) * size[2] + z]
+struct plane {
+  float *cells;
+  float *operator[](int y){ return cells + (long)y * CELLS_ARRAY_SIZE[2]; }
+};
+
+struct grid {
+  float *cells;
+  plane operator[](int x){
+    plane p = {cells + (long)x * CELLS_ARRAY_SIZE[1] * CELLS_ARRAY_SIZE[2]};
+    return p;
+  }
+};
+
+grid cells_main_array   = {NULL};
+grid cells_buffer_array = {NULL};
+
+static float CELL_ALIVE = 0.2f;
+static float CELL_DEAD  = 0.0f;
+static float CELL_MIN_COLOUR  = 0.2f;
+static float CELL_MAX_COLOUR  = 0.8f;
+static float CELL_STEP_COLOUR = 0.05f;
+
+int stat_iteration      = 0;
+int stat_alive          = 0;
+int stat_change         = 0;
+
+float simulation_cell_gain_colour(float colour, float step = CELL_STEP_COLOUR){
+   float new_colour = colour + step;
+   if (new_colour > CELL_MAX_COLOUR){
+      new_colour = CELL_MAX_COLOUR;
+   }
+   return new_colour;
+}
+
+float simulation_cell_lose_colour(float colour, float step = CELL_STEP_COLOUR){
+   float new_colour = colour - step;
+   if (new_colour < CELL_MIN_COLOUR){
+      new_colour = CELL_MIN_COLOUR;
+   }
+   return new_colour;
+}
+
+int simulation_count_neigbours(int cx, int cy, int cz, float treshold){
+  int neigbours = 0;
+
+  for (int z = cz-1; z <= cz+1; z++){
+  for (int y = cy-1; y <= cy+1; y++){
+  for (int x = cx-1; x <= cx+1; x++){
+    if (x >= 0 and y >= 0 and z >= 0 and x < CELLS_ARRAY_SIZE[0] and y < CELLS_ARRAY_SIZE[1] and z < CELLS_ARRAY_SIZE[2]){
+      if(!( x == cx and y == cy and z == cz)){
+      if(!(z==cz-1 and y==cy-1 and x==cx-1)){
+      if(!(z==cz-1 and y==cy-1 and x==cx+1)){
+      if(!(z==cz-1 and y==cy+1 and x==cx-1)){
+      if(!(z==cz-1 and y==cy+1 and x==cx+1)){
+      if(!(z==cz+1 and y==cy-1 and x==cx-1)){
+      if(!(z==cz+1 and y==cy-1 and x==cx+1)){
+      if(!(z==cz+1 and y==cy+1 and x==cx-1)){
+      if(!(z==cz+1 and y==cy+1 and x==cx+1)){ // am I crazy already?
+      if (cells_main_array[x][y][z] >= treshold){
+        neigbours++;
+      }}}}}}}}}}
+    }
+  }}}
+
+  return neigbours;
+}
+
+void simulation_do_work(){
+   int neigbours;
+   float cell;
+   float new_cell;
+
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+    neigbours = simulation_count_neigbours(x, y, z, CELL_ALIVE);
+    cell = cells_main_array[x][y][z];
+    if (cell > CELL_ALIVE){
+      if (neigbours < 2 or neigbours > 6){
+         new_cell = simulation_cell_lose_colour(cell);
+      }else{
+         new_cell = simulation_cell_gain_colour(cell);
+      }
+    }else{
+        if (neigbours == 5 ){
+           new_cell = simulation_cell_gain_colour(cell);
+        }else{
+           new_cell = CELL_DEAD;
+        }
+     }
+    cells_buffer_array[x][y][z] = new_cell;
+  }}}
+}
+
+void simulation_swap_arrays(){
+  float old_cell;
+  float new_cell;
+
+  stat_alive = 0;
+  stat_change = 0;
+
+  for (int z = 0; z < CELLS_ARRAY_SIZE[2]; z++){
+  for (int y = 0; y < CELLS_ARRAY_SIZE[1]; y++){
+  for (int x = 0; x < CELLS_ARRAY_SIZE[0]; x++){
+    old_cell = cells_main_array[x][y][z];
+    new_cell = cells_buffer_array[x][y][z];
+    cells_main_array[x][y][z] = new_cell;
+    if (new_cell > CELL_ALIVE){
+      stat_alive++;
+    }
+    if (old_cell != new_cell){
+      stat_change++;
+    }
+  }}}
+}
+
+void simulation_loop(){
+  simulation_do_work();
+  if (stat_alive > 0){
+    stat_iteration++;
+  }
+  simulation_swap_arrays();
+}
+
+// a w x h x d grid with the given cells, stats cleared
+void setup(int w, int h, int d, const float *cells){
+  long count = (long)w * h * d;
+  CELLS_ARRAY_SIZE[0] = w;
+  CELLS_ARRAY_SIZE[1] = h;
+  CELLS_ARRAY_SIZE[2] = d;
+  free(cells_main_array.cells);
+  free(cells_buffer_array.cells);
+  cells_main_array.cells = (float*)malloc(count * sizeof(float));
+  cells_buffer_array.cells = (float*)calloc(count, sizeof(float));
+  memcpy(cells_main_array.cells, cells, count * sizeof(float));
+  stat_iteration = stat_alive = stat_change = 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,393 @@
+// ----------------------------------------
+// Cellular Automaton Engine - rewind
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Recent history of a running engine, kept in memory to step back and
+// scrub through generations that already ran. Every generation keeps the
+// cells the change hook reported (the ones behind stat_change) with their
+// old values: a reverse delta that turns it back into the one before.
+// Every rewind_keyframe_every generations the whole grid is kept as well.
+// When the keyframes in use cover the history and a new one is due, the
+// interval doubles and every other one is freed, so they always span all
+// the history kept and a seek never replays more than one interval of
+// deltas. Filling or restoring the grid is recorded like a generation,
+// so it does not cut the history. All of it fits in rewind_budget_mb;
+// the oldest generations are dropped first.
+//
+// Seeking moves a view grid of its own and reports every cell it changes
+// to a hook, so LOD and meshes follow incrementally; the engine stays at
+// the newest generation until rewind_resume() carries on from the one on
+// view, dropping the ones after it.
+//
+// ----------------------------------------
+
+#ifndef CA_REWIND_H
+#define CA_REWIND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ca_engine.h"
+
+static const int REWIND_MAX_GENERATIONS = 1 << 16;
+static const int REWIND_MAX_KEYFRAMES   = 64;
+
+struct rewind_change {
+  int index;
+  float old_cell;
+};
+
+// generation g undoes changes [first, first + count) of the change ring
+struct rewind_generation {
+  unsigned long long first;
+  int count;
+  int iteration;
+  int alive;
+  int change;
+};
+
+struct rewind_keyframe {
+  long generation;
+  float *cells;
+};
+
+static int rewind_budget_mb           = 64;
+static int rewind_keyframe_every      = 64;
+// the interval in use, rewind_keyframe_every doubled as the history grows
+static long rewind_keyframe_interval  = 64;
+static bool rewind_on                 = false;
+static int rewind_size[3];
+static long rewind_count              = 0;
+
+// changes [rewind_tail, rewind_head) are kept, the ring wraps
+static rewind_change *rewind_changes  = NULL;
+static unsigned long long rewind_capacity = 0;
+static unsigned long long rewind_head = 0;
+static unsigned long long rewind_tail = 0;
+// the open generation overflowed the ring, the history starts over
+static bool rewind_overflow           = false;
+
+// generations (rewind_newest - rewind_depth, rewind_newest] have records
+static rewind_generation *rewind_generations = NULL;
+static int rewind_generation_capacity = 0;
+static long rewind_newest             = 0;
+static long rewind_depth              = 0;
+// stats of the oldest generation, which has no record of its own
+static rewind_generation rewind_base;
+
+static rewind_keyframe rewind_keyframes[REWIND_MAX_KEYFRAMES];
+static int rewind_keyframe_count      = 0;
+
+static float *rewind_view             = NULL;
+static float *rewind_scratch          = NULL;
+static long rewind_view_generation    = 0;
+static bool rewind_viewing            = false;
+
+static long rewind_oldest(){
+  return rewind_newest - rewind_depth;
+}
+
+static rewind_generation *rewind_get(long generation){
+  if (generation == rewind_oldest()) return &rewind_base;
+  return &rewind_generations[generation % rewind_generation_capacity];
+}
+
+static void rewind_set_stats(rewind_generation *g, const ca_stats *stats){
+  g->iteration = stats->iteration;
+  g->alive = stats->alive;
+  g->change = stats->change;
+}
+
+static void rewind_drop_oldest(){
+  if (rewind_depth == 0) return;
+  rewind_generation *g = rewind_get(rewind_oldest() + 1);
+  rewind_tail = g->first + g->count;
+  rewind_base = *g;
+  rewind_depth--;
+}
+
+static void rewind_forget(const ca_stats *stats){
+  rewind_tail = rewind_head;
+  rewind_depth = 0;
+  rewind_set_stats(&rewind_base, stats);
+  rewind_keyframe_interval = rewind_keyframe_every;
+  for (int k = 0; k < rewind_keyframe_count; k++){
+    rewind_keyframes[k].generation = -1;
+  }
+}
+
+// where a keyframe of the newest generation goes, NULL when none is due;
+// a slot is free once the history has dropped its generation
+static rewind_keyframe *rewind_keyframe_slot(){
+  while (rewind_newest % rewind_keyframe_interval == 0){
+    for (int k = 0; k < rewind_keyframe_count; k++){
+      if (rewind_keyframes[k].generation < rewind_oldest()) return &rewind_keyframes[k];
+    }
+    rewind_keyframe_interval *= 2;
+    for (int k = 0; k < rewind_keyframe_count; k++){
+      if (rewind_keyframes[k].generation % rewind_keyframe_interval != 0) rewind_keyframes[k].generation = -1;
+    }
+  }
+  return NULL;
+}
+
+// sizes the rings for the engine's grid and starts the history at its
+// current generation; the budget holds the keyframes, the generation
+// records and the changes (up to a quarter goes to keyframes and an
+// eighth to the records), 0 MB turns rewinding off
+static bool rewind_start(ca_engine *engine){
+  if (rewind_budget_mb <= 0) return false;
+  memcpy(rewind_size, ca_size(engine), sizeof(rewind_size));
+  rewind_count = (long)rewind_size[0] * rewind_size[1] * rewind_size[2];
+
+  size_t budget = (size_t)rewind_budget_mb << 20;
+  size_t grid_bytes = rewind_count * sizeof(float);
+  if (rewind_keyframe_every < 1) rewind_keyframe_every = 1;
+  rewind_keyframe_interval = rewind_keyframe_every;
+  rewind_keyframe_count = budget / 4 / grid_bytes;
+  if (rewind_keyframe_count > REWIND_MAX_KEYFRAMES) rewind_keyframe_count = REWIND_MAX_KEYFRAMES;
+  if (rewind_keyframe_count < 1) rewind_keyframe_count = 1;
+  rewind_generation_capacity = budget / 8 / sizeof(rewind_generation);
+  if (rewind_generation_capacity > REWIND_MAX_GENERATIONS) rewind_generation_capacity = REWIND_MAX_GENERATIONS;
+  size_t fixed = (rewind_keyframe_count + 2) * grid_bytes + rewind_generation_capacity * sizeof(rewind_generation);
+  if (budget < fixed + rewind_count * sizeof(rewind_change)){
+    fprintf(stderr, "rewind: %i MB is too little for this grid\n", rewind_budget_mb);
+    return false;
+  }
+  rewind_capacity = (budget - fixed) / sizeof(rewind_change);
+
+  rewind_changes = (rewind_change*)malloc(rewind_capacity * sizeof(rewind_change));
+  rewind_generations = (rewind_generation*)malloc(rewind_generation_capacity * sizeof(rewind_generation));
+  rewind_view = (float*)malloc(grid_bytes);
+  rewind_scratch = (float*)malloc(grid_bytes);
+  bool ok = rewind_changes and rewind_generations and rewind_view and rewind_scratch;
+  for (int k = 0; k < rewind_keyframe_count and ok; k++){
+    rewind_keyframes[k].generation = -1;
+    rewind_keyframes[k].cells = (float*)malloc(grid_bytes);
+    ok = rewind_keyframes[k].cells != NULL;
+  }
+  if (!ok){
+    fprintf(stderr, "rewind: out of memory\n");
+    for (int k = 0; k < rewind_keyframe_count; k++){
+      free(rewind_keyframes[k].cells);
+      rewind_keyframes[k].cells = NULL;
+    }
+    free(rewind_changes);
+    free(rewind_generations);
+    free(rewind_view);
+    free(rewind_scratch);
+    rewind_changes = NULL;
+    rewind_generations = NULL;
+    rewind_view = NULL;
+    rewind_scratch = NULL;
+    return false;
+  }
+  rewind_set_stats(&rewind_base, ca_get_stats(engine));
+  rewind_on = true;
+  return true;
+}
+
+// from the engine's change hook: one changed cell of the generation
+// being stepped
+static void rewind_record(int x, int y, int z, float old_cell){
+  if (!rewind_on or rewind_overflow) return;
+  if (rewind_head - rewind_tail == rewind_capacity){
+    // the open generation must keep all of its changes
+    while (rewind_depth > 0 and rewind_head - rewind_tail == rewind_capacity){
+      rewind_drop_oldest();
+    }
+    if (rewind_head - rewind_tail == rewind_capacity){
+      rewind_overflow = true;
+      return;
+    }
+  }
+  rewind_change *change = &rewind_changes[rewind_head % rewind_capacity];
+  change->index = (x * rewind_size[1] + y) * rewind_size[2] + z;
+  change->old_cell = old_cell;
+  rewind_head++;
+}
+
+// closes the generation just stepped (or edited); first is where its
+// changes start in the ring
+static void rewind_close(ca_engine *engine, unsigned long long first){
+  const ca_stats *stats = ca_get_stats(engine);
+
+  if (rewind_overflow){
+    rewind_overflow = false;
+    rewind_head = first;
+    rewind_newest++;
+    rewind_forget(stats);
+    return;
+  }
+  if (rewind_depth == rewind_generation_capacity){
+    rewind_drop_oldest();
+  }
+  rewind_newest++;
+  rewind_depth++;
+  rewind_generation *g = rewind_get(rewind_newest);
+  g->first = first;
+  g->count = rewind_head - first;
+  rewind_set_stats(g, stats);
+
+  rewind_keyframe *k = rewind_keyframe_slot();
+  if (k){
+    memcpy(k->cells, ca_cells(engine), rewind_count * sizeof(float));
+    k->generation = rewind_newest;
+  }
+}
+
+// where the generation being stepped starts, see rewind_tick()
+static unsigned long long rewind_open = 0;
+
+// call after every step, on the stepping thread
+static void rewind_tick(ca_engine *engine){
+  if (!rewind_on) return;
+  rewind_close(engine, rewind_open);
+  rewind_open = rewind_head;
+}
+
+// undoes one generation on the view grid
+static void rewind_undo(long generation, ca_change_hook hook, void *user){
+  const rewind_generation *g = rewind_get(generation);
+  int h = rewind_size[1], d = rewind_size[2];
+
+  // the same cell changes once per generation, the order does not matter
+  for (int i = 0; i < g->count; i++){
+    const rewind_change *change = &rewind_changes[(g->first + i) % rewind_capacity];
+    float cell = rewind_view[change->index];
+    rewind_view[change->index] = change->old_cell;
+    if (hook and cell != change->old_cell){
+      hook(user, change->index / d / h, change->index / d % h, change->index % d, cell, change->old_cell);
+    }
+  }
+}
+
+// puts a whole grid on view, reporting the cells that differ
+static void rewind_load(const float *cells, ca_change_hook hook, void *user){
+  int h = rewind_size[1], d = rewind_size[2];
+  for (long i = 0; i < rewind_count; i++){
+    if (rewind_view[i] == cells[i]) continue;
+    if (hook) hook(user, i / d / h, i / d % h, i % d, rewind_view[i], cells[i]);
+    rewind_view[i] = cells[i];
+  }
+}
+
+// shows generation (clamped to the history); the view ends on the newest
+static void rewind_seek(ca_engine *engine, long generation, ca_change_hook hook, void *user){
+  if (!rewind_on) return;
+  if (generation < rewind_oldest()) generation = rewind_oldest();
+  if (generation > rewind_newest) generation = rewind_newest;
+  if (!rewind_viewing){
+    if (generation == rewind_newest) return;
+    memcpy(rewind_view, ca_cells(engine), rewind_count * sizeof(float));
+    rewind_view_generation = rewind_newest;
+    rewind_viewing = true;
+  }
+
+  long from = rewind_view_generation;
+  if (generation > from or from - generation > rewind_keyframe_interval){
+    // the nearest grid at or after the target: a keyframe or the engine
+    const float *cells = ca_cells(engine);
+    from = rewind_newest;
+    for (int k = 0; k < rewind_keyframe_count; k++){
+      long at = rewind_keyframes[k].generation;
+      if (at >= generation and at < from and at <= rewind_newest){
+        cells = rewind_keyframes[k].cells;
+        from = at;
+      }
+    }
+    rewind_load(cells, hook, user);
+  }
+  for (long g = from; g > generation; g--){
+    rewind_undo(g, hook, user);
+  }
+  rewind_view_generation = generation;
+  rewind_viewing = generation != rewind_newest;
+}
+
+// moves the view by generations (negative is back)
+static void rewind_step(ca_engine *engine, int generations, ca_change_hook hook, void *user){
+  rewind_seek(engine, (rewind_viewing ? rewind_view_generation : rewind_newest) + generations, hook, user);
+}
+
+// carries on from the generation on view and forgets the ones after it;
+// the view already matches, so nothing needs redrawing
+static void rewind_resume(ca_engine *engine){
+  if (!rewind_viewing) return;
+  const rewind_generation *g = rewind_get(rewind_view_generation);
+  ca_state state;
+  ca_get_state(engine, &state);
+  memset(&state.stats, 0, sizeof(state.stats));
+  state.stats.iteration = g->iteration;
+  state.stats.alive = g->alive;
+  state.stats.change = g->change;
+  ca_set_state(engine, &state, rewind_view);
+
+  for (int k = 0; k < rewind_keyframe_count; k++){
+    if (rewind_keyframes[k].generation > rewind_view_generation) rewind_keyframes[k].generation = -1;
+  }
+  rewind_depth -= rewind_newest - rewind_view_generation;
+  rewind_newest = rewind_view_generation;
+  rewind_head = g == &rewind_base ? rewind_tail : g->first + g->count;
+  rewind_open = rewind_head;
+  rewind_viewing = false;
+}
+
+// around anything that replaces the grid outside ca_step() (a refill, a
+// restore): the difference is kept as one generation. A view in progress
+// goes back to the newest generation first.
+static void rewind_edit_begin(ca_engine *engine, ca_change_hook hook, void *user){
+  if (!rewind_on) return;
+  rewind_seek(engine, rewind_newest, hook, user);
+  memcpy(rewind_scratch, ca_cells(engine), rewind_count * sizeof(float));
+}
+
+static void rewind_edit_end(ca_engine *engine){
+  if (!rewind_on) return;
+  const float *cells = ca_cells(engine);
+  unsigned long long first = rewind_head;
+  for (long i = 0; i < rewind_count and !rewind_overflow; i++){
+    if (rewind_scratch[i] == cells[i]) continue;
+    int z = i % rewind_size[2];
+    int y = i / rewind_size[2] % rewind_size[1];
+    int x = i / rewind_size[2] / rewind_size[1];
+    rewind_record(x, y, z, rewind_scratch[i]);
+  }
+  rewind_close(engine, first);
+  rewind_open = rewind_head;
+}
+
+// the grid and stats to show: the view while rewound, else the engine's
+static const float *rewind_cells(ca_engine *engine){
+  return rewind_viewing ? rewind_view : ca_cells(engine);
+}
+
+static void rewind_stats(ca_engine *engine, int *iteration, int *alive, int *change){
+  const ca_stats *stats = ca_get_stats(engine);
+  *iteration = stats->iteration;
+  *alive = stats->alive;
+  *change = stats->change;
+  if (rewind_viewing){
+    const rewind_generation *g = rewind_get(rewind_view_generation);
+    *iteration = g->iteration;
+    *alive = g->alive;
+    *change = g->change;
+  }
+}
+
+// "REWIND: [-12/840 2.1MB]" for the HUD
+static void rewind_status(char *text, int len){
+  if (!rewind_on){
+    text[0] = '\0';
+    return;
+  }
+  double used = (rewind_head - rewind_tail) * sizeof(rewind_change) / 1048576.0;
+  snprintf(text, len, "REWIND: [%li/%li %.1fMB]%s",
+    rewind_viewing ? rewind_view_generation - rewind_newest : 0, rewind_depth, used,
+    rewind_viewing ? " PAUSED" : "");
+}
+
+#endif
@@ -0,0 +1,144 @@
+// ----------------------------------------
+// Cellular Automaton Engine - step scheduler
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Decides how many generations run per frame. It keeps running averages
+// of the step and draw times and fills the frame budget with steps:
+//
+// SCHED_FRAME  one generation per frame (the classic behaviour)
+// SCHED_MAX    as many generations as fit in the frame
+// SCHED_FIXED  sched_target generations per second; when the steps do
+//              not fit in the frame the frame is skipped instead, and
+//              the steps get its draw time too
+//
+// The step callback returns false when no generation ran (e.g. paused
+// while rewound); the frame then stops stepping and nothing is counted.
+//
+// ----------------------------------------
+
+#ifndef CA_SCHEDULER_H
+#define CA_SCHEDULER_H
+
+#include <time.h>
+
+static const int SCHED_FRAME = 0;
+static const int SCHED_MAX   = 1;
+static const int SCHED_FIXED = 2;
+static const char *SCHED_NAMES[] = {"FRAME", "MAX", "FIXED"};
+
+// never skip more frames than this in a row, the window has to respond
+static const int SCHED_MAX_SKIP = 4;
+
+static int sched_mode           = SCHED_FRAME;
+static float sched_target       = 60.0f;
+static double sched_step_ms     = 0.0;
+static double sched_draw_ms     = 0.0;
+static double sched_owed        = 0.0;
+static double sched_last_tick   = 0.0;
+static double sched_tick_start  = 0.0;
+static double sched_draw_start  = 0.0;
+static double sched_window      = 0.0;
+static int sched_window_gens    = 0;
+static int sched_window_frames  = 0;
+static int sched_skipped        = 0;
+static float stat_gens_per_sec  = 0.0f;
+static float stat_frame_ms      = 0.0f;
+
+static double sched_time(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec * 1e-6;
+}
+
+static void sched_average(double *average, double sample){
+  *average = *average == 0.0 ? sample : *average * 0.9 + sample * 0.1;
+}
+
+static bool sched_step(bool (*step)()){
+  double start = sched_time();
+  if (!step()) return false;
+  sched_average(&sched_step_ms, sched_time() - start);
+  sched_window_gens++;
+  return true;
+}
+
+static void sched_next_mode(){
+  sched_mode = (sched_mode + 1) % 3;
+  sched_owed = 0.0;
+}
+
+static void sched_change_target(float factor){
+  sched_target *= factor;
+  if (sched_target < 1.0f) sched_target = 1.0f;
+  if (sched_target > 100000.0f) sched_target = 100000.0f;
+}
+
+// runs this frame's generations, returns false when the frame should
+// not be drawn
+static bool sched_run(bool (*step)(), int frame_ms){
+  double now = sched_time();
+  double dt = sched_last_tick == 0.0 ? frame_ms : now - sched_last_tick;
+  double budget = frame_ms - sched_draw_ms;
+  bool draw = true;
+
+  sched_last_tick = now;
+  sched_tick_start = now;
+  if (budget < 1.0) budget = 1.0;
+
+  if (sched_mode == SCHED_FRAME){
+    sched_step(step);
+  }else if (sched_mode == SCHED_MAX){
+    while (sched_step(step) and sched_time() - now + sched_step_ms < budget);
+  }else{
+    sched_owed += dt * 0.001 * sched_target;
+    // do not try to catch up more than a second of lag
+    if (sched_owed > sched_target) sched_owed = sched_target;
+    while (sched_owed >= 1.0){
+      if (!sched_step(step)){
+        sched_owed = 0.0;
+        break;
+      }
+      sched_owed -= 1.0;
+      if (sched_owed < 1.0 or sched_time() - now + sched_step_ms < budget) continue;
+      // behind: skip drawing this frame and step through its draw time
+      if (!draw or sched_skipped >= SCHED_MAX_SKIP) break;
+      sched_skipped++;
+      draw = false;
+      budget = frame_ms < 1 ? 1.0 : frame_ms;
+      if (sched_time() - now + sched_step_ms >= budget) break;
+    }
+  }
+  if (draw) sched_skipped = 0;
+
+  if (now - sched_window >= 1000.0){
+    if (sched_window > 0.0){
+      double span = now - sched_window;
+      stat_gens_per_sec = sched_window_gens * 1000.0 / span;
+      stat_frame_ms = sched_window_frames > 0 ? span / sched_window_frames : span;
+    }
+    sched_window = now;
+    sched_window_gens = 0;
+    sched_window_frames = 0;
+  }
+  return draw;
+}
+
+// time left until the next tick should start
+static int sched_delay(int frame_ms){
+  int spent = (int)(sched_time() - sched_tick_start);
+  return spent < frame_ms ? frame_ms - spent : 0;
+}
+
+static void sched_draw_begin(){
+  sched_draw_start = sched_time();
+}
+
+static void sched_draw_end(){
+  sched_average(&sched_draw_ms, sched_time() - sched_draw_start);
+  sched_window_frames++;
+}
+
+#endif
@@ -0,0 +1,122 @@
+// ----------------------------------------
+// Cellular Automaton Engine - telemetry
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Per-generation stats for ca2d and ca3d. The simulation pushes the
+// engine's ca_stats once per generation into a single-producer ring, a writer
+// thread drains it into a CSV file (or raw records if the file name ends
+// with .bin). Pushing never blocks: when the ring is full the record is
+// dropped and counted.
+//
+// ----------------------------------------
+
+#ifndef CA_TELEMETRY_H
+#define CA_TELEMETRY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include "ca_engine.h"
+
+static const int TELEMETRY_BINS = CA_STATS_BINS;
+static const unsigned TELEMETRY_RING = 4096;
+
+// one record per generation, straight from ca_get_stats()
+typedef ca_stats telemetry_record;
+
+static telemetry_record telemetry_ring[TELEMETRY_RING];
+static std::atomic<unsigned> telemetry_head(0);
+static std::atomic<unsigned> telemetry_tail(0);
+static std::atomic<bool> telemetry_running(false);
+static FILE *telemetry_file = NULL;
+static bool telemetry_binary = false;
+static pthread_t telemetry_thread;
+static int stat_telemetry_dropped = 0;
+
+static void telemetry_write(const telemetry_record *r){
+  if (telemetry_binary){
+    fwrite(r, sizeof(*r), 1, telemetry_file);
+    return;
+  }
+  fprintf(telemetry_file, "%i,%i,%i,%.4f,%i,%i,%i,%i,%i,%i",
+    r->iteration, r->alive, r->change, r->step_ms,
+    r->box_min[0], r->box_min[1], r->box_min[2],
+    r->box_max[0], r->box_max[1], r->box_max[2]);
+  for (int i = 0; i < TELEMETRY_BINS; i++){
+    fprintf(telemetry_file, ",%i", r->histogram[i]);
+  }
+  fputc('\n', telemetry_file);
+}
+
+static void telemetry_drain(){
+  unsigned tail = telemetry_tail.load(std::memory_order_relaxed);
+  unsigned head = telemetry_head.load(std::memory_order_acquire);
+
+  while (tail != head){
+    telemetry_write(&telemetry_ring[tail % TELEMETRY_RING]);
+    tail++;
+    telemetry_tail.store(tail, std::memory_order_release);
+  }
+}
+
+static void *telemetry_writer(void *arg){
+  struct timespec nap = {0, 10 * 1000000};
+
+  while (telemetry_running.load(std::memory_order_acquire)){
+    telemetry_drain();
+    nanosleep(&nap, NULL);
+  }
+  telemetry_drain();
+  return NULL;
+}
+
+static void telemetry_push(const telemetry_record *record){
+  if (!telemetry_file) return;
+  unsigned head = telemetry_head.load(std::memory_order_relaxed);
+  if (head - telemetry_tail.load(std::memory_order_acquire) >= TELEMETRY_RING){
+    stat_telemetry_dropped++;
+    return;
+  }
+  telemetry_ring[head % TELEMETRY_RING] = *record;
+  telemetry_head.store(head + 1, std::memory_order_release);
+}
+
+static void telemetry_stop(){
+  if (!telemetry_file) return;
+  telemetry_running.store(false, std::memory_order_release);
+  pthread_join(telemetry_thread, NULL);
+  fclose(telemetry_file);
+  telemetry_file = NULL;
+  if (stat_telemetry_dropped > 0){
+    fprintf(stderr, "telemetry: %i records dropped\n", stat_telemetry_dropped);
+  }
+}
+
+static bool telemetry_start(const char *path){
+  int len = strlen(path);
+  telemetry_binary = len > 4 and strcmp(path + len - 4, ".bin") == 0;
+  telemetry_file = fopen(path, telemetry_binary ? "wb" : "w");
+  if (!telemetry_file){
+    perror(path);
+    return false;
+  }
+  if (!telemetry_binary){
+    fprintf(telemetry_file, "iteration,alive,change,step_ms,min_x,min_y,min_z,max_x,max_y,max_z");
+    for (int i = 0; i < TELEMETRY_BINS; i++){
+      fprintf(telemetry_file, ",h%i", i);
+    }
+    fputc('\n', telemetry_file);
+  }
+  telemetry_running.store(true, std::memory_order_release);
+  pthread_create(&telemetry_thread, NULL, telemetry_writer, NULL);
+  atexit(telemetry_stop);
+  return true;
+}
+
+#endif
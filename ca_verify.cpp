@@ -0,0 +1,350 @@
+// ----------------------------------------
+// Cellular Automaton Engine - differential verifier
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Repo:
+// https://github.com/w84death/cellular-automaton
+//
+// Runs random grids through ca_engine at every instruction set the CPU
+// has and a few thread counts, next to the reference kernels from
+// ca_reference.h, and compares a checksum of every generation. Sizes,
+// densities, cell values and where the cells sit (all over, only along
+// the border, solid edges) change from run to run. The first difference
+// is reported with its generation and cell and the program exits with 1.
+//
+// 2D runs are repeated on ca_world (the chunked plane without edges) at
+// every instruction set: the cells go somewhere across chunk borders and
+// below zero, and the reference gets a grid with room on every side for
+// anything to spread into.
+//
+// Linux:
+// g++ -O2 -fopenmp ca_verify.cpp ca_engine.cpp -o ca_verify.app -lm -lpthread -lrt
+//
+// Usage:
+// ./ca_verify.app [runs] [generations] [seed]
+//
+// ----------------------------------------
+
+// LIBS
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "ca_engine.h"
+#include "ca_reference.h"
+
+// SYSTEM VARS
+// ----------------------------------------------------------------------------
+
+int runs                  = 60;
+int generations           = 100;
+unsigned long long seed   = 0;
+unsigned long long rng    = 0;
+
+static const int MODE_2D_COLOUR   = 0;
+static const int MODE_2D_CONWAY   = 1;
+static const int MODE_3D          = 2;
+static const char *MODE_NAMES[]   = {"2D colour", "2D Conway", "3D"};
+
+// where the random cells go; outside the grid is always dead, so the
+// border cells are the ones that see it
+static const int SEED_UNIFORM     = 0;
+static const int SEED_BORDER      = 1;
+static const int SEED_EDGES       = 2;
+static const char *SEED_NAMES[]   = {"uniform", "border", "edges"};
+
+static const int MAX_ENGINES      = 16;
+
+// one engine under test: an instruction set stepped on a number of threads
+struct verify_engine {
+  ca_engine *engine;
+  int isa;
+  int threads;
+};
+
+verify_engine engines[MAX_ENGINES];
+int engine_count          = 0;
+
+// RANDOM
+// ----------------------------------------------------------------------------
+
+unsigned long long random_u(){
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return rng * 0x2545f4914f6cdd1dULL;
+}
+
+float random_f(){
+  return (random_u() >> 40) / (float)(1 << 24);
+}
+
+int random_i(int min, int max){
+  return min + random_u() % (max - min + 1);
+}
+
+// a live cell: mostly exact values the rules compare against or clamp
+// to, the rest anywhere in (0, 1]
+float random_cell(int mode){
+  static const float VALUES_2D[] = {0.005f, 0.05f, 0.2f, 0.3f, 0.5f, 0.995f, 1.0f};
+  static const float VALUES_3D[] = {0.05f, 0.2f, 0.25f, 0.4f, 0.75f, 0.8f};
+  if (random_f() < 0.5f) return 1.0f - random_f();
+  if (mode == MODE_3D) return VALUES_3D[random_u() % 6];
+  return VALUES_2D[random_u() % 7];
+}
+
+// GRIDS
+// ----------------------------------------------------------------------------
+
+void random_size(int mode, int *size){
+  int max = mode == MODE_3D ? 48 : 160;
+  float shape = random_f();
+
+  for (int i = 0; i < 3; i++){
+    if (shape < 0.15f){
+      size[i] = random_i(1, 5);
+    }else if (shape < 0.3f){
+      size[i] = mode == MODE_3D ? 36 : i == 0 ? 84 : 48;
+    }else{
+      size[i] = random_i(1, max);
+    }
+  }
+  if (mode != MODE_3D) size[2] = 1;
+}
+
+void random_cells(int mode, const int *size, int pattern, float density, float *cells){
+  for (int x = 0; x < size[0]; x++){
+  for (int y = 0; y < size[1]; y++){
+  for (int z = 0; z < size[2]; z++){
+    int edge = x;
+    if (size[0] - 1 - x < edge) edge = size[0] - 1 - x;
+    if (y < edge) edge = y;
+    if (size[1] - 1 - y < edge) edge = size[1] - 1 - y;
+    if (mode == MODE_3D){
+      if (z < edge) edge = z;
+      if (size[2] - 1 - z < edge) edge = size[2] - 1 - z;
+    }
+    bool alive;
+    if (pattern == SEED_BORDER){
+      alive = edge < 2 and random_f() < density;
+    }else if (pattern == SEED_EDGES){
+      alive = edge == 0 or random_f() < density;
+    }else{
+      alive = random_f() < density;
+    }
+    cells[((long)x * size[1] + y) * size[2] + z] = alive ? random_cell(mode) : 0.0f;
+  }}}
+}
+
+// FNV-1a over the bits of the cells
+unsigned long long checksum(const float *cells, long count){
+  const unsigned char *bytes = (const unsigned char*)cells;
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  for (long i = 0; i < count * (long)sizeof(float); i++){
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// ENGINES
+// ----------------------------------------------------------------------------
+
+void engines_create(int mode, const int *size, const float *cells){
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  // and every thread the machine has, when that is more
+  int thread_counts[] = {1, 2, 3, max_threads};
+  int counts = max_threads > 3 ? 4 : 3;
+
+  ca_rule rule = ca_rule_default(mode == MODE_3D ? 3 : 2);
+  rule.conway = mode == MODE_2D_CONWAY;
+  engine_count = 0;
+  for (int isa = CA_ISA_SCALAR; isa <= ca_isa_supported(); isa++){
+    for (int t = 0; t < counts and engine_count < MAX_ENGINES; t++){
+      verify_engine *v = &engines[engine_count++];
+      v->engine = ca_create(mode == MODE_3D ? 3 : 2, size, &rule);
+      if (!v->engine){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+      }
+      v->isa = ca_set_isa(v->engine, isa);
+      v->threads = thread_counts[t];
+      ca_set_cells(v->engine, cells);
+    }
+  }
+}
+
+void engines_destroy(){
+  for (int i = 0; i < engine_count; i++){
+    ca_destroy(engines[i].engine);
+  }
+  engine_count = 0;
+}
+
+void engine_step(verify_engine *v){
+#ifdef _OPENMP
+  omp_set_num_threads(v->threads);
+#endif
+  ca_step(v->engine, 1);
+}
+
+// WORLD
+// ----------------------------------------------------------------------------
+
+// the grid seeded into a world at x, y at every ISA, stepped against the
+// reference; 0 when they differ
+int verify_world(int run, int mode, const int *size, const float *cells){
+  int pad = generations + 1;
+  int w = size[0] + 2 * pad, h = size[1] + 2 * pad;
+  int x = random_i(-3 * CA_CHUNK_SIZE, CA_CHUNK_SIZE), y = random_i(-3 * CA_CHUNK_SIZE, CA_CHUNK_SIZE);
+  float *padded = (float*)calloc((long)w * h, sizeof(float));
+  float *window = (float*)malloc((long)w * h * sizeof(float));
+  ca_world *worlds[CA_ISA_AVX512 + 1];
+  int world_count = 0;
+
+  for (int i = 0; i < size[0]; i++){
+    memcpy(padded + (long)(i + pad) * h + pad, cells + (long)i * size[1], size[1] * sizeof(float));
+  }
+  ref2d::setup(w, h, mode == MODE_2D_CONWAY, padded);
+  ca_rule rule = ca_rule_default(2);
+  rule.conway = mode == MODE_2D_CONWAY;
+  for (int isa = CA_ISA_SCALAR; isa <= ca_isa_supported(); isa++){
+    ca_world *world = ca_world_create(&rule);
+    ca_world_set_isa(world, isa);
+    for (int i = 0; i < w; i++){
+    for (int j = 0; j < h; j++){
+      ca_world_set_cell(world, x + i, y + j, padded[(long)i * h + j]);
+    }}
+    worlds[world_count++] = world;
+  }
+
+  bool same = true;
+  for (int g = 0; g < generations and same; g++){
+    ref2d::run_automation();
+    const float *expected = ref2d::cells_main_array.cells;
+    for (int i = 0; i < world_count and same; i++){
+      ca_world_step(worlds[i], 1);
+      ca_world_read(worlds[i], x, y, w, h, window);
+      const ca_stats *stats = ca_world_get_stats(worlds[i]);
+      if (memcmp(window, expected, (long)w * h * sizeof(float)) == 0 and stats->alive == ref2d::stat_alive
+        and stats->change == ref2d::stat_change and stats->iteration == ref2d::stat_iteration) continue;
+      printf("run %i generation %i: world at %i %i on %s differs from the reference\n", run, g, x, y, ca_isa_name(i));
+      for (long c = 0; c < (long)w * h; c++){
+        if (memcmp(&window[c], &expected[c], sizeof(float)) == 0) continue;
+        printf("  first cell [%li %li]: reference %.9g world %.9g\n", x + c / h, y + c % h, expected[c], window[c]);
+        break;
+      }
+      printf("  stats: reference alive %i change %i iteration %i, world alive %i change %i iteration %i\n",
+        ref2d::stat_alive, ref2d::stat_change, ref2d::stat_iteration, stats->alive, stats->change, stats->iteration);
+      printf("  repeat with: ./ca_verify.app %i %i %llu\n", run + 1, g + 1, seed);
+      same = false;
+    }
+  }
+  for (int i = 0; i < world_count; i++){
+    ca_world_destroy(worlds[i]);
+  }
+  free(padded);
+  free(window);
+  return same;
+}
+
+// MAIN
+// ----------------------------------------------------------------------------
+
+// prints the first cell (x, then y, then z) where the engine and the
+// reference disagree
+void report(int run, int generation, const verify_engine *v, const int *size, const float *expected, const ca_stats *stats, int alive, int change, int iteration){
+  const float *cells = ca_cells(v->engine);
+  printf("run %i generation %i: %s on %i threads differs from the reference\n",
+    run, generation, ca_isa_name(v->isa), v->threads);
+  for (long i = 0; i < (long)size[0] * size[1] * size[2]; i++){
+    if (memcmp(&cells[i], &expected[i], sizeof(float)) == 0) continue;
+    int z = i % size[2];
+    int y = i / size[2] % size[1];
+    int x = i / size[2] / size[1];
+    printf("  first cell [%i %i %i]: reference %.9g engine %.9g\n", x, y, z, expected[i], cells[i]);
+    break;
+  }
+  if (stats->alive != alive or stats->change != change or stats->iteration != iteration){
+    printf("  stats: reference alive %i change %i iteration %i, engine alive %i change %i iteration %i\n",
+      alive, change, iteration, stats->alive, stats->change, stats->iteration);
+  }
+  printf("  repeat with: ./ca_verify.app %i %i %llu\n", run + 1, generation + 1, seed);
+}
+
+int main(int argc, char** argv) {
+  seed = time(NULL);
+  if (argc > 1) runs = atoi(argv[1]);
+  if (argc > 2) generations = atoi(argv[2]);
+  if (argc > 3) seed = strtoull(argv[3], NULL, 10);
+  rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+  printf("seed %llu, best ISA %s\n", seed, ca_isa_name(ca_isa_supported()));
+
+  for (int run = 0; run < runs; run++){
+    int mode = run % 3;
+    int size[3];
+    random_size(mode, size);
+    int pattern = random_u() % 3;
+    float density = random_f();
+    long count = (long)size[0] * size[1] * size[2];
+    float *cells = (float*)malloc(count * sizeof(float));
+    random_cells(mode, size, pattern, density, cells);
+
+    if (mode == MODE_3D){
+      ref3d::setup(size[0], size[1], size[2], cells);
+    }else{
+      ref2d::setup(size[0], size[1], mode == MODE_2D_CONWAY, cells);
+    }
+    engines_create(mode, size, cells);
+
+    for (int g = 0; g < generations; g++){
+      const float *expected;
+      int alive, change, iteration;
+      if (mode == MODE_3D){
+        ref3d::simulation_loop();
+        expected = ref3d::cells_main_array.cells;
+        alive = ref3d::stat_alive;
+        change = ref3d::stat_change;
+        iteration = ref3d::stat_iteration;
+      }else{
+        ref2d::run_automation();
+        expected = ref2d::cells_main_array.cells;
+        alive = ref2d::stat_alive;
+        change = ref2d::stat_change;
+        iteration = ref2d::stat_iteration;
+      }
+      unsigned long long sum = checksum(expected, count);
+
+      for (int i = 0; i < engine_count; i++){
+        verify_engine *v = &engines[i];
+        engine_step(v);
+        const ca_stats *stats = ca_get_stats(v->engine);
+        if (checksum(ca_cells(v->engine), count) != sum
+          or stats->alive != alive or stats->change != change or stats->iteration != iteration){
+          report(run, g, v, size, expected, stats, alive, change, iteration);
+          return 1;
+        }
+      }
+    }
+    printf("run %i: %s %ix%ix%i, %s, density %.2f: %i generations on %i engines match\n",
+      run, MODE_NAMES[mode], size[0], size[1], size[2], SEED_NAMES[pattern], density, generations, engine_count);
+    engines_destroy();
+    if (mode != MODE_3D){
+      if (!verify_world(run, mode, size, cells)) return 1;
+      printf("run %i: %s on the world matches\n", run, MODE_NAMES[mode]);
+    }
+    free(cells);
+  }
+  printf("%i runs of %i generations: no differences\n", runs, generations);
+  return 0;
+}
@@ -0,0 +1,125 @@
+// ----------------------------------------
+// Cellular Automaton Engine - shared-memory reader
+// Krzysztof Jankowski <kj@p1x.in>
+//
+// (c)2015 P1X
+// http://p1x.in
+//
+// Repo:
+// https://github.com/w84death/cellular-automaton
+//
+// Maps the segment of a running ca2d/ca3d (started with --publish)
+// read-only and prints every frame it gets. Shows how to read a frame
+// in place: the cells are summed straight from the mapping and the
+// slot sequence is checked afterwards. Any number can run at once.
+//
+// Linux:
+// g++ -O2 ca_watch.cpp -o ca_watch.app -lrt
+//
+// Usage:
+// ./ca2d.app --publish /ca2d &
+// ./ca_watch.app /ca2d [frames]
+//
+// ----------------------------------------
+
+// LIBS
+// ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ca_publish_layout.h"
+
+// SYSTEM VARS
+// ----------------------------------------------------------------------------
+
+int frames            = 100;
+int stat_torn         = 0;
+int stat_missed       = 0;
+
+// MAIN
+// ----------------------------------------------------------------------------
+
+const publish_header *watch_open(const char *name){
+  char path[256];
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+  struct timespec nap = {0, 100 * 1000000};
+
+  // wait for the simulation to create and fill in the segment
+  for (int tries = 0; tries < 100; tries++, nanosleep(&nap, NULL)){
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) continue;
+    struct stat st;
+    if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(publish_header)){
+      close(fd);
+      continue;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) break;
+    const publish_header *header = (const publish_header*)map;
+    if (header->magic == PUBLISH_MAGIC and header->version == PUBLISH_VERSION){
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return header;
+    }
+    munmap(map, st.st_size);
+  }
+  fprintf(stderr, "%s: no published grid\n", path);
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2){
+    fprintf(stderr, "usage: %s /name [frames]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2){
+    frames = atoi(argv[2]);
+  }
+  const publish_header *header = watch_open(argv[1]);
+  if (!header) return 1;
+
+  long count = (long)header->size[0] * header->size[1] * header->size[2];
+  printf("%iD %ix%ix%i, %i slots\n", header->dims, header->size[0], header->size[1], header->size[2], header->slots);
+
+  unsigned long long last = ~0ULL;
+  struct timespec nap = {0, 1000000};
+  for (int got = 0; got < frames; ){
+    unsigned long long frame = header->latest.load(std::memory_order_acquire);
+    if (frame == ~0ULL or frame == last){
+      nanosleep(&nap, NULL);
+      continue;
+    }
+    const publish_slot *slot = publish_get_slot(header, frame % header->slots);
+    unsigned long long begin = slot->sequence.load(std::memory_order_acquire);
+    if (begin != 2 * frame + 2) continue;
+
+    // zero-copy: read the cells where the simulation put them
+    const float *cells = (const float*)((const char*)slot + header->cells_offset);
+    double sum = 0.0;
+    for (long i = 0; i < count; i++){
+      sum += cells[i];
+    }
+    ca_stats stats = slot->stats;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) != begin){
+      stat_torn++;
+      continue;
+    }
+    if (last != ~0ULL and frame > last + 1){
+      stat_missed += frame - last - 1;
+    }
+    last = frame;
+    got++;
+    printf("FRAME: [%llu] ITERATION: [%i] ALIVE: [%i/%li] CHANGE: [%i] SUM: [%.3f]\n",
+      frame, stats.iteration, stats.alive, count, stats.change, sum);
+  }
+  fprintf(stderr, "%i frames, %i skipped, %i overwritten while reading\n", frames, stat_missed, stat_torn);
+  return 0;
+}